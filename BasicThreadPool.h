@@ -0,0 +1,631 @@
+///
+/// \file BasicThreadPool.h
+/// \brief Policy-based thread pool template for compile-time configuration
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __BASIC_THREAD_POOL_H_INCL__
+#define __BASIC_THREAD_POOL_H_INCL__
+
+#include "ThreadPoolInvocation.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+///
+/// \brief Queue policy storing pending tasks in an unbounded FIFO (std::deque)
+///
+struct FifoQueuePolicy
+{
+    ///
+    /// \brief Queue of pending tasks
+    ///
+    /// \tparam T Task type of the pool
+    ///
+    template<class T> class Queue
+    {
+    public:
+        void Push(T&& task)
+        {
+            tasks_.push_back(std::move(task));
+        }
+
+        T Pop()
+        {
+            T task = std::move(tasks_.front());
+            tasks_.pop_front();
+            return task;
+        }
+
+        bool Empty() const
+        {
+            return tasks_.empty();
+        }
+
+        bool Full() const
+        {
+            return false;
+        }
+
+        size_t Size() const
+        {
+            return tasks_.size();
+        }
+
+    private:
+        std::deque<T> tasks_; ///< Pending tasks in submission order
+    };
+};
+
+///
+/// \brief Queue policy storing pending tasks in a fixed-capacity ring buffer
+///
+/// The ring is allocated once when the pool is constructed, so submission
+/// never allocates queue storage. A full ring saturates the pool like a full
+/// queue.
+///
+/// \tparam Capacity Maximum number of pending tasks
+///
+template<size_t Capacity> struct RingQueuePolicy
+{
+    static_assert(Capacity > 0, "RingQueuePolicy requires a non-zero capacity");
+
+    ///
+    /// \brief Queue of pending tasks
+    ///
+    /// \tparam T Task type of the pool
+    ///
+    template<class T> class Queue
+    {
+    public:
+        Queue() : slots_(std::make_unique<T[]>(Capacity)), head_(0), size_(0)
+        {
+        }
+
+        void Push(T&& task)
+        {
+            slots_[(head_ + size_) % Capacity] = std::move(task);
+            size_++;
+        }
+
+        T Pop()
+        {
+            T task = std::move(slots_[head_]);
+            slots_[head_] = T(); // Release the moved-from slot's state early
+            head_         = (head_ + 1) % Capacity;
+            size_--;
+            return task;
+        }
+
+        bool Empty() const
+        {
+            return 0 == size_;
+        }
+
+        bool Full() const
+        {
+            return Capacity == size_;
+        }
+
+        size_t Size() const
+        {
+            return size_;
+        }
+
+    private:
+        std::unique_ptr<T[]> slots_; ///< Ring storage
+        size_t               head_;  ///< Index of the oldest pending task
+        size_t               size_;  ///< Number of pending tasks
+    };
+};
+
+///
+/// \brief Idle policy blocking idle workers on a condition variable
+///
+struct BlockingIdlePolicy
+{
+    ///
+    /// \brief Waits until the predicate holds
+    ///
+    /// \param lock Lock on the pool's queue mutex
+    /// \param ready Predicate evaluated under the lock
+    ///
+    template<class Predicate> void Wait(std::unique_lock<std::mutex>& lock, Predicate ready)
+    {
+        available_.wait(lock, ready);
+    }
+
+    void NotifyOne()
+    {
+        available_.notify_one();
+    }
+
+    void NotifyAll()
+    {
+        available_.notify_all();
+    }
+
+private:
+    std::condition_variable available_; ///< Condition variable for task availability
+};
+
+///
+/// \brief Idle policy polling the queue for a while before blocking
+///
+/// Trades CPU time for wake-up latency: a worker that finds the queue empty
+/// yields and re-checks up to SpinCount times before it blocks, so bursts of
+/// short tasks are picked up without a futex wake-up.
+///
+/// \tparam SpinCount Number of re-checks before blocking
+///
+template<size_t SpinCount = 1024> struct SpinningIdlePolicy
+{
+    ///
+    /// \brief Polls the predicate, then waits until it holds
+    ///
+    /// \param lock Lock on the pool's queue mutex
+    /// \param ready Predicate evaluated under the lock
+    ///
+    template<class Predicate> void Wait(std::unique_lock<std::mutex>& lock, Predicate ready)
+    {
+        for (size_t spin = 0; spin < SpinCount && false == ready(); ++spin)
+        {
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+
+        available_.wait(lock, ready);
+    }
+
+    void NotifyOne()
+    {
+        available_.notify_one();
+    }
+
+    void NotifyAll()
+    {
+        available_.notify_all();
+    }
+
+private:
+    std::condition_variable available_; ///< Condition variable for task availability
+};
+
+///
+/// \brief Task policy storing tasks in std::function
+///
+/// std::function requires copyable callables; move-only task state is moved
+/// into a shared allocation first.
+///
+struct FunctionTaskPolicy
+{
+    using Task = std::function<void()>;
+
+    ///
+    /// \brief Wraps a callable in a task
+    ///
+    template<class Callable> static Task MakeTask(Callable&& callable)
+    {
+        if constexpr (std::is_copy_constructible_v<std::decay_t<Callable>>)
+        {
+            return Task(std::forward<Callable>(callable));
+        }
+        else
+        {
+            return Task([state = std::make_shared<std::decay_t<Callable>>(std::forward<Callable>(callable))] { (*state)(); });
+        }
+    }
+};
+
+///
+/// \brief Task policy storing tasks in std::move_only_function
+///
+/// Accepts move-only callables directly, so a task and its promise need no
+/// shared allocation; small callables are stored inline.
+///
+struct MoveOnlyTaskPolicy
+{
+    using Task = std::move_only_function<void()>;
+
+    ///
+    /// \brief Wraps a callable in a task
+    ///
+    template<class Callable> static Task MakeTask(Callable&& callable)
+    {
+        return Task(std::forward<Callable>(callable));
+    }
+};
+
+///
+/// \brief Metrics policy that records nothing
+///
+/// All hooks are empty and inline, so they compile away entirely.
+///
+struct NoMetricsPolicy
+{
+    void OnSubmitted(const size_t /*queuedTasks*/)
+    {
+    }
+
+    void OnRejected()
+    {
+    }
+
+    void OnCompleted()
+    {
+    }
+
+    void OnUnhandledException(const std::exception_ptr& /*exception*/)
+    {
+    }
+};
+
+///
+/// \brief Metrics policy counting submitted, rejected and completed tasks
+///
+struct CountingMetricsPolicy
+{
+    std::atomic<uint64_t> submittedTasks {0};      ///< Tasks accepted by Enqueue or TryEnqueue
+    std::atomic<uint64_t> rejectedTasks {0};       ///< Tasks rejected by TryEnqueue
+    std::atomic<uint64_t> completedTasks {0};      ///< Tasks that finished executing
+    std::atomic<size_t>   peakQueuedTasks {0};     ///< Highest number of pending tasks observed at submission
+    std::atomic<uint64_t> unhandledExceptions {0}; ///< Exceptions thrown by TryEnqueue tasks, which have no future
+
+    void OnSubmitted(const size_t queuedTasks)
+    {
+        submittedTasks.fetch_add(1, std::memory_order_relaxed);
+
+        // Called under the queue mutex, so a plain compare suffices
+        if (queuedTasks > peakQueuedTasks.load(std::memory_order_relaxed))
+        {
+            peakQueuedTasks.store(queuedTasks, std::memory_order_relaxed);
+        }
+    }
+
+    void OnRejected()
+    {
+        rejectedTasks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnCompleted()
+    {
+        completedTasks.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void OnUnhandledException(const std::exception_ptr& /*exception*/)
+    {
+        unhandledExceptions.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+///
+/// \brief Thread pool whose queue, idle strategy, task type and metrics are chosen at compile time
+///
+/// BasicThreadPool provides the core of ThreadPool - Enqueue with futures,
+/// non-blocking TryEnqueue, bounded queues with backpressure and
+/// WaitForAllTasks - with every configurable aspect selected by a policy
+/// instead of a runtime branch. All policy calls are resolved statically and
+/// can be inlined, so unused features cost nothing on the hot path.
+///
+/// The full-featured ThreadPool class (admission control, lanes, reactor,
+/// memory resources) remains the general-purpose pool; DefaultThreadPool is
+/// the BasicThreadPool configuration with ThreadPool's core behavior.
+///
+/// \tparam QueuePolicy Provides Queue<Task> (e.g. FifoQueuePolicy, RingQueuePolicy)
+/// \tparam IdlePolicy How idle workers wait (e.g. BlockingIdlePolicy, SpinningIdlePolicy)
+/// \tparam TaskPolicy Task type and wrapping (e.g. FunctionTaskPolicy, MoveOnlyTaskPolicy)
+/// \tparam MetricsPolicy Submission and completion hooks (e.g. NoMetricsPolicy, CountingMetricsPolicy);
+///         the OnUnhandledException hook is optional
+///
+/// \note This class is not copyable or movable.
+/// \note Thread safety: All operations are thread-safe.
+///
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy> class BasicThreadPool
+{
+public:
+    using Task = typename TaskPolicy::Task;
+
+    ///
+    /// \brief Constructs a thread pool with the specified number of threads
+    ///
+    /// \param threadCount Number of worker threads to create in the pool
+    /// \param maxQueueSize Maximum size of the task queue (defaults to 10'000)
+    /// \throws std::system_error If thread creation fails
+    ///
+    BasicThreadPool(const size_t threadCount, const size_t maxQueueSize = 10'000);
+
+    ///
+    /// \brief Destructor - stops all threads and waits for their completion
+    ///
+    /// Workers finish the tasks already queued before they exit.
+    ///
+    ~BasicThreadPool();
+
+    // Delete copy constructor and assignment operator
+    BasicThreadPool(const BasicThreadPool&)            = delete;
+    BasicThreadPool& operator=(const BasicThreadPool&) = delete;
+
+    ///
+    /// \brief Enqueues a task to be executed by the thread pool
+    ///
+    /// If the queue is full, this method will block briefly and then add the
+    /// task regardless of queue size to prevent deadlock (unless the queue
+    /// policy has no room left, in which case it waits for room). The callable
+    /// and its arguments are stored decayed and invoked once as rvalues.
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param f The callable object to execute
+    /// \param args Arguments to pass to the callable object
+    /// \return std::future<return_type> A future that will hold the result of the task
+    /// \throws std::runtime_error If the thread pool has been stopped
+    ///
+    template<class F, class... Args> auto Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>;
+
+    ///
+    /// \brief Attempts to enqueue a task without blocking
+    ///
+    /// Without a future there is no receiver for exceptions thrown by the task;
+    /// they are passed to the metrics policy's OnUnhandledException hook, or
+    /// discarded if the policy has none.
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param f The callable object to execute
+    /// \param args Arguments to pass to the callable object
+    /// \return bool True if the task was enqueued, false if the queue was full or the pool was stopped
+    ///
+    template<class F, class... Args> bool TryEnqueue(F&& f, Args&&... args);
+
+    ///
+    /// \brief Blocks until all tasks have completed
+    ///
+    void WaitForAllTasks();
+
+    ///
+    /// \brief Returns the metrics policy instance
+    ///
+    /// \return const MetricsPolicy& Metrics recorded by the pool
+    ///
+    const MetricsPolicy& GetMetrics() const;
+
+private:
+    using Queue = typename QueuePolicy::template Queue<Task>;
+
+    std::vector<std::thread>            workers_;      ///< Collection of worker threads
+    Queue                               tasks_;        ///< Queue of pending tasks
+    std::mutex                          queueMutex_;   ///< Mutex protecting the task queue
+    IdlePolicy                          idle_;         ///< Wait strategy of idle workers
+    std::condition_variable             finished_;     ///< Condition variable for task completion
+    std::condition_variable             queueNotFull_; ///< Condition variable for queue space
+    bool                                stop_;         ///< Flag indicating shutdown
+    size_t                              activeTasks_;  ///< Counter of currently executing tasks
+    const size_t                        maxQueueSize_; ///< Maximum number of pending tasks
+    [[no_unique_address]] MetricsPolicy metrics_;      ///< Submission and completion hooks
+
+    ///
+    /// \brief Main loop of a worker thread
+    ///
+    void RunWorker();
+
+    ///
+    /// \brief Checks if the queue is at its configured limit
+    ///
+    /// \note Thread safety: The caller must hold the queueMutex_
+    ///
+    bool IsQueueSaturated() const;
+
+    ///
+    /// \brief Wraps a callable in a task, adds it to the queue and wakes a worker
+    ///
+    /// \note Thread safety: The caller must hold the queueMutex_
+    ///
+    template<class Callable> void PushTask(Callable&& callable);
+};
+
+///
+/// \brief BasicThreadPool configuration with ThreadPool's core behavior
+///
+using DefaultThreadPool = BasicThreadPool<FifoQueuePolicy, BlockingIdlePolicy, FunctionTaskPolicy, NoMetricsPolicy>;
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::BasicThreadPool(const size_t threadCount, const size_t maxQueueSize) :
+    stop_(false), activeTasks_(0), maxQueueSize_(maxQueueSize)
+{
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        workers_.emplace_back([this] { RunWorker(); });
+    }
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::~BasicThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        stop_ = true;
+    }
+
+    idle_.NotifyAll();
+    queueNotFull_.notify_all();
+
+    for (std::thread& worker : workers_)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+template<class F, class... Args>
+auto BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::Enqueue(F&& f, Args&&... args)
+    -> std::future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>
+{
+    using return_type = typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type;
+
+    std::promise<return_type> promise;
+    std::future<return_type>  futureResult = promise.get_future();
+
+    auto callable = [promise = std::move(promise), function = ThreadPoolDetail::MakeInvocation(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+        try
+        {
+            if constexpr (std::is_void_v<return_type>)
+            {
+                function();
+                promise.set_value();
+            }
+            else
+            {
+                promise.set_value(function());
+            }
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    };
+
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    // Don't allow enqueueing after stopping the pool
+    if (true == stop_)
+    {
+        throw std::runtime_error("enqueue on stopped BasicThreadPool");
+    }
+
+    // If queue is full, wait only briefly to avoid deadlock
+    if (true == IsQueueSaturated())
+    {
+        queueNotFull_.wait_for(lock, std::chrono::milliseconds(100), [this] { return stop_ || false == IsQueueSaturated(); });
+    }
+
+    // A fixed-capacity queue cannot overflow, so wait for room instead
+    if (true == tasks_.Full())
+    {
+        queueNotFull_.wait(lock, [this] { return stop_ || false == tasks_.Full(); });
+        if (true == stop_)
+        {
+            throw std::runtime_error("enqueue on stopped BasicThreadPool");
+        }
+    }
+
+    PushTask(std::move(callable));
+    return futureResult;
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+template<class F, class... Args>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::TryEnqueue(F&& f, Args&&... args)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    if (true == stop_)
+    {
+        return false;
+    }
+
+    if (true == IsQueueSaturated())
+    {
+        metrics_.OnRejected();
+        return false;
+    }
+
+    // Without a future there is no receiver for exceptions, so they go to the metrics policy
+    PushTask([this, function = ThreadPoolDetail::MakeInvocation(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+        try
+        {
+            function();
+        }
+        catch (...)
+        {
+            if constexpr (requires(MetricsPolicy& metrics, const std::exception_ptr& exception) { metrics.OnUnhandledException(exception); })
+            {
+                metrics_.OnUnhandledException(std::current_exception());
+            }
+        }
+    });
+    return true;
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::WaitForAllTasks()
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    finished_.wait(lock, [this] { return tasks_.Empty() && 0 == activeTasks_; });
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+const MetricsPolicy& BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::GetMetrics() const
+{
+    return metrics_;
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+void BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::RunWorker()
+{
+    for (;;)
+    {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            idle_.Wait(lock, [this] { return stop_ || false == tasks_.Empty(); });
+
+            // Exit once the pool is stopping and the queue has been drained
+            if (true == stop_ && tasks_.Empty())
+            {
+                return;
+            }
+
+            task = tasks_.Pop();
+            activeTasks_++;
+        }
+
+        // Room in the queue for a waiting producer
+        queueNotFull_.notify_one();
+
+        task();
+        task = Task(); // Release the task's state before reporting completion
+        metrics_.OnCompleted();
+
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        activeTasks_--;
+        if (0 == activeTasks_ && tasks_.Empty())
+        {
+            finished_.notify_all();
+        }
+    }
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+bool BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::IsQueueSaturated() const
+{
+    return tasks_.Size() >= maxQueueSize_ || tasks_.Full();
+}
+
+template<class QueuePolicy, class IdlePolicy, class TaskPolicy, class MetricsPolicy>
+template<class Callable>
+void BasicThreadPool<QueuePolicy, IdlePolicy, TaskPolicy, MetricsPolicy>::PushTask(Callable&& callable)
+{
+    tasks_.Push(TaskPolicy::MakeTask(std::forward<Callable>(callable)));
+    metrics_.OnSubmitted(tasks_.Size());
+    idle_.NotifyOne();
+}
+
+#endif // __BASIC_THREAD_POOL_H_INCL__
@@ -7,52 +7,378 @@
 ///
 
 #include "ThreadPool.h"
+#include "ThreadPoolTrace.h"
 #include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
 
-ThreadPool::ThreadPool(const size_t threadCount, const size_t maxQueueSize) : stop_(false), activeTasks_(0), maxQueueSize_(maxQueueSize)
+#if defined(__linux__)
+#include "ThreadPoolPerfCounters.h"
+#include "ThreadPoolSharedStats.h"
+#include <cerrno>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Static tracepoints for bpftrace, perf and SystemTap, e.g.
+// bpftrace -e 'usdt:./libthreadpool.so:threadpool:dequeue { @wait = hist(arg1); }'.
+// Unattached, a probe is a single nop; without sys/sdt.h the arguments are not even evaluated
+#if defined(THREADPOOL_HAS_USDT)
+#include <sys/sdt.h>
+#define THREADPOOL_PROBE1(name, a)       DTRACE_PROBE1(threadpool, name, a)
+#define THREADPOOL_PROBE2(name, a, b)    DTRACE_PROBE2(threadpool, name, a, b)
+#define THREADPOOL_PROBE3(name, a, b, c) DTRACE_PROBE3(threadpool, name, a, b, c)
+#else
+#define THREADPOOL_PROBE1(name, a)       static_cast<void>(sizeof(a))
+#define THREADPOOL_PROBE2(name, a, b)    static_cast<void>(sizeof(a) + sizeof(b))
+#define THREADPOOL_PROBE3(name, a, b, c) static_cast<void>(sizeof(a) + sizeof(b) + sizeof(c))
+#endif
+
+namespace
 {
-    // Create the specified number of worker threads
-    for (size_t i = 0; i < threadCount; ++i)
+///
+/// \brief Pool and queue of the calling worker thread
+///
+struct WorkerContext
+{
+    const ThreadPool* pool   = nullptr; ///< Pool the thread works for (nullptr for other threads)
+    size_t            queue  = 0;       ///< Index of the worker's own queue
+    size_t            domain = 0;       ///< Domain of the worker
+};
+
+thread_local WorkerContext currentWorker;
+
+///
+/// \brief Trace id of the task the calling worker runs (zero if it is not recorded)
+///
+thread_local uint64_t currentTraceId = 0;
+
+#if defined(__linux__)
+///
+/// \brief Performance counters of the calling worker, opened on its first measured task
+///
+thread_local std::unique_ptr<PerfCounterGroup> workerCounters;
+#endif
+
+///
+/// \brief Tag reported for tasks whose tag did not fit into a worker's table
+///
+constexpr const char* OverflowTag = "(other)";
+
+///
+/// \brief Returns the start slot of a tag in a worker's open-addressed table
+///
+/// Tags are string literals in practice, so their address identifies them.
+///
+size_t TagHash(const char* tag)
+{
+    return static_cast<size_t>((reinterpret_cast<uintptr_t>(tag) * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+///
+/// \brief Compares tags by name, as the same tag may be a different literal in another translation unit
+///
+bool SameTag(const char* a, const char* b)
+{
+    return a == b || (nullptr != a && nullptr != b && 0 == std::strcmp(a, b));
+}
+
+///
+/// \brief Returns the steady_clock time in nanoseconds since its epoch
+///
+int64_t SteadyNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+///
+/// \brief Adds to a counter that only the calling thread writes, without a locked instruction
+///
+void AddOwned(std::atomic<int64_t>& counter, const int64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+///
+/// \brief Per-thread xorshift generator for sampling queues without shared state
+///
+uint64_t NextRandom()
+{
+    thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+///
+/// \brief Jump consistent hash (Lamping and Veach): maps a key to one of count buckets
+///
+/// Needs no table, and when the number of buckets grows by one only 1/count of
+/// the keys move.
+///
+size_t JumpConsistentHash(uint64_t key, const size_t count)
+{
+    int64_t bucket = -1;
+    int64_t next   = 0;
+    while (next < static_cast<int64_t>(count))
     {
-        // Each thread is created with a lambda that defines its work loop
-        workers_.emplace_back([this] {
-            // Infinite loop - will only exit when an empty task is received
-            for (;;)
-            {
-                // Get a task from the queue - this might block if no tasks are available
-                // or return an empty function if the pool is stopping
-                std::function<void()> task = GetNextTask();
+        bucket = next;
+        key    = key * 2862933555777941757ULL + 1;
+        next   = static_cast<int64_t>(static_cast<double>(bucket + 1) * (static_cast<double>(1LL << 31) / static_cast<double>((key >> 33) + 1)));
+    }
+    return static_cast<size_t>(bucket);
+}
 
-                // An empty task signals that the worker should exit
-                // This happens when the pool is being destroyed and there are no more tasks
-                if (!task)
-                {
-                    return;
-                }
+///
+/// \brief Returns the bits of a 64-bit bitmap word that belong to the index range [first, end)
+///
+uint64_t RangeMask(const size_t word, const size_t first, const size_t end)
+{
+    uint64_t mask = ~uint64_t(0);
+    if (word == first / 64)
+    {
+        mask &= ~uint64_t(0) << (first % 64);
+    }
+    if (word == (end - 1) / 64 && 0 != end % 64)
+    {
+        mask &= ~uint64_t(0) >> (64 - end % 64);
+    }
+    return mask;
+}
+
+///
+/// \brief Restricts the calling thread to the given CPUs
+///
+void PinToCpus(const std::vector<unsigned>& cpus)
+{
+#if defined(__linux__)
+    if (cpus.empty() == true)
+    {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const unsigned cpu : cpus)
+    {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    // Pinning is a placement hint - if it is not permitted, the worker runs wherever the scheduler puts it
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    static_cast<void>(cpus);
+#endif
+}
+
+#if defined(__linux__)
+///
+/// \brief Reads the run-queue wait of a thread of this process from /proc/self/task/<tid>/schedstat
+///
+/// The file holds the time on the CPU, the time runnable but waiting for a CPU
+/// (both in nanoseconds) and the number of timeslices.
+///
+/// \return int64_t Run-queue wait in nanoseconds, zero if the kernel does not provide it
+///
+int64_t ReadRunQueueTime(const int threadId)
+{
+    std::ifstream file("/proc/self/task/" + std::to_string(threadId) + "/schedstat");
+    int64_t       onCpu    = 0;
+    int64_t       runQueue = 0;
+    if (!(file >> onCpu >> runQueue))
+    {
+        return 0;
+    }
+    return runQueue;
+}
+
+///
+/// \brief Reads the context switch counts of a thread of this process from /proc/self/task/<tid>/status
+///
+void ReadContextSwitches(const int threadId, uint64_t& voluntary, uint64_t& involuntary)
+{
+    std::ifstream file("/proc/self/task/" + std::to_string(threadId) + "/status");
+    std::string   line;
+    while (std::getline(file, line))
+    {
+        if (line.rfind("voluntary_ctxt_switches:", 0) == 0)
+        {
+            voluntary = std::stoull(line.substr(line.find(':') + 1));
+        }
+        else if (line.rfind("nonvoluntary_ctxt_switches:", 0) == 0)
+        {
+            involuntary = std::stoull(line.substr(line.find(':') + 1));
+        }
+    }
+}
+
+///
+/// \brief Number of shared statistics segments created by this process, used for the default names
+///
+std::atomic<unsigned> sharedStatsSegments(0);
+#endif
+} // namespace
+
+template<class Entry> template<class Update> void ThreadPool::TagTable<Entry>::Add(const char* tag, Update update)
+{
+    if (nullptr == tag)
+    {
+        update(untagged);
+        return;
+    }
+
+    const size_t hash = TagHash(tag);
+    for (size_t probe = 0; probe < TagTableSize; ++probe)
+    {
+        Entry&      entry    = entries[(hash + probe) & (TagTableSize - 1)];
+        const char* entryTag = entry.tag.load(std::memory_order_relaxed);
+        if (tag == entryTag)
+        {
+            update(entry);
+            return;
+        }
+
+        if (nullptr == entryTag)
+        {
+            // Publish the tag after the totals, so that a snapshot never sees a claimed empty entry
+            update(entry);
+            entry.tag.store(tag, std::memory_order_release);
+            return;
+        }
+    }
+
+    update(overflow);
+}
+
+template<class Entry> template<class Visit> void ThreadPool::TagTable<Entry>::ForEach(Visit visit) const
+{
+    for (const Entry& entry : entries)
+    {
+        const char* tag = entry.tag.load(std::memory_order_acquire);
+        if (nullptr != tag)
+        {
+            visit(tag, entry);
+        }
+    }
 
-                // At this point we've removed a task from the queue, so notify any
-                // producers that were waiting because the queue was full
-                queueNotFull_.notify_one();
+    if (0 != untagged.values[0].load(std::memory_order_relaxed))
+    {
+        visit(nullptr, untagged);
+    }
+    if (0 != overflow.values[0].load(std::memory_order_relaxed))
+    {
+        visit(OverflowTag, overflow);
+    }
+}
 
-                // Execute the task - this is done outside of any locks to allow maximum concurrency
-                task();
+ThreadPool::ThreadPool(const size_t threadCount, const size_t maxQueueSize, std::pmr::memory_resource* memoryResource) :
+    ThreadPool(std::vector<DomainLayout> {DomainLayout {threadCount, {}}}, maxQueueSize, memoryResource)
+{
+}
 
-                // After task execution, update our bookkeeping and potentially notify waiters
-                NotifyTaskCompletion();
+ThreadPool::ThreadPool(const CpuTopology& topology, const size_t maxQueueSize, std::pmr::memory_resource* memoryResource) :
+    ThreadPool(
+        [&topology] {
+            // One worker per CPU, pinned to the CPUs of its domain
+            std::vector<DomainLayout> layout;
+            for (const CpuTopology::Domain& domain : topology.GetDomains())
+            {
+                layout.push_back(DomainLayout {domain.cpus.size(), domain.cpus});
             }
-        });
+            return layout;
+        }(),
+        maxQueueSize, memoryResource)
+{
+}
+
+ThreadPool::ThreadPool(const std::vector<DomainLayout>& layout, const size_t maxQueueSize, std::pmr::memory_resource* memoryResource) :
+    defaultResource_((nullptr != memoryResource) ? memoryResource : TaskMemoryResource::Default()), queuedTasks_(0), stealableTasks_(0),
+    stolenTasks_(0), remoteSteals_(0), affinityTasks_(0), affinityHits_(0), stop_(false), activeTasks_(0), maxQueueSize_(maxQueueSize), admissionTarget_(std::chrono::nanoseconds(0)),
+    admissionInterval_(std::chrono::nanoseconds(0)), lastSojournTime_(std::chrono::nanoseconds(0)), admissionEnabled_(false), overloaded_(false), rejectedTasks_(0), maxQueuedBytes_(0),
+    queuedBytes_(0), waitingProducers_(0), heldTasks_(0), timerStop_(false), parkedWorkers_(0), epollFd_(-1), wakeFd_(-1), polling_(false),
+    wakePending_(false), pollFailed_(false), memoryResource_(defaultResource_), exceptionCount_(0), dedupHits_(0), perfCounters_(false), hardwareCounters_(false), tagCosts_(false), workerTime_(false), watchdogEnabled_(false), watchdogThreshold_(0), watchdogElastic_(false),
+    watchdogArmed_(false), stuckTasks_(0), replacementCount_(0), tracing_(false), nextTraceId_(1)
+#if defined(__linux__)
+    , sharedStatsInterval_(0), sharedStatsArmed_(false), sharedStatsEnabled_(false)
+#endif
+{
+    // One queue per worker, with the queues of a domain next to each other
+    for (const DomainLayout& entry : layout)
+    {
+        domains_.push_back(WorkerDomain {queues_.size(), entry.workers, entry.cpus});
+        for (size_t i = 0; i < entry.workers; ++i)
+        {
+            queues_.push_back(std::make_unique<WorkerQueue>(defaultResource_, domains_.size() - 1));
+        }
+    }
+
+    // A pool without workers still needs a queue to hold its tasks
+    const size_t threadCount = queues_.size();
+    if (queues_.empty() == true)
+    {
+        queues_.push_back(std::make_unique<WorkerQueue>(defaultResource_, 0));
+        domains_.front().queueCount = 1;
+    }
+
+    idleWorkers_ = std::make_unique<std::atomic<uint64_t>[]>((queues_.size() + 63) / 64);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        perfTables_.push_back(std::make_unique<PerfCounterTable>());
+        tagCostTables_.push_back(std::make_unique<TagCostTable>());
+        workerSlots_.push_back(std::make_unique<WorkerSlot>(i, nullptr, 0));
+    }
+
+    // Create the specified number of worker threads
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        workers_.emplace_back([this, i] { RunWorker(i, *workerSlots_[i]); });
     }
 }
 
 ThreadPool::~ThreadPool()
 {
-    // Tell all threads they should exit when they next check for work
+    // Tell all threads they should exit when they next check for work; tasks
+    // that are still running can no longer submit from here on
     SignalThreadsToStop();
 
+    // Stop the timer thread before the workers so that no timer callback touches
+    // the task queue while they shut down. Timers scheduled after this point
+    // (by running tasks or the watchdog) are dropped by ScheduleTimer
+    {
+        std::unique_lock<std::mutex> lock(timerMutex_);
+        timerStop_ = true;
+    }
+    timerCondition_.notify_all();
+    if (true == timerThread_.joinable())
+    {
+        timerThread_.join();
+    }
+
     // Wake up all threads that might be waiting on the condition variables
-    // This ensures they check the stop_ flag and can exit cleanly
-    condition_.notify_all();
+    // or in epoll_wait. This ensures they check the stop_ flag and can exit cleanly
+    for (const std::unique_ptr<WorkerQueue>& queue : queues_)
+    {
+        queue->condition.notify_all();
+    }
     queueNotFull_.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        WakePoller();
+    }
 
     // Wait for each thread to finish its current task and exit
     // Without this join, threads could be terminated while still working
@@ -60,6 +386,20 @@ ThreadPool::~ThreadPool()
     {
         worker.join();
     }
+
+    // Replacement threads exit like workers; the stopped timer thread no longer starts new ones
+    for (Replacement& replacement : replacements_)
+    {
+        replacement.thread.join();
+    }
+
+#if defined(__linux__)
+    if (epollFd_ >= 0)
+    {
+        close(epollFd_);
+        close(wakeFd_);
+    }
+#endif
 }
 
 void ThreadPool::SignalThreadsToStop()
@@ -71,65 +411,1641 @@ void ThreadPool::SignalThreadsToStop()
     stop_ = true;
 }
 
-std::function<void()> ThreadPool::GetNextTask()
+ThreadPool::WorkerSlot::WorkerSlot(const size_t slotWorker, const WorkerSlot* slotReplaces, const int64_t slotReplacedStart) :
+    startTime(0), tag(nullptr), exited(false), worker(slotWorker), replaces(slotReplaces), replacedStart(slotReplacedStart), reportedStart(0),
+    threadId(0), threadStart(0), tasks(0), runningTime(0), parkedTime(0)
 {
-    // Lock the queue mutex to safely access the task queue
-    std::unique_lock<std::mutex> lock(queueMutex_);
+}
+
+void ThreadPool::RunWorker(const size_t worker, WorkerSlot& slot)
+{
+    // Tasks submitted by this worker go to its own queue
+    const size_t domain = queues_[worker]->domain;
+    currentWorker       = WorkerContext {this, worker, domain};
+    PinToCpus(domains_[domain].cpus);
+
+#if defined(__linux__)
+    // The clock is published with the thread id, which marks the slot as readable
+    pthread_getcpuclockid(pthread_self(), &slot.cpuClock);
+    slot.threadId.store(static_cast<int>(syscall(SYS_gettid)), std::memory_order_release);
+#endif
+    slot.threadStart.store(SteadyNanoseconds(), std::memory_order_relaxed);
+
+    // Infinite loop - will only exit when an empty task is received
+    for (;;)
+    {
+        // Get a task from the queues - this might block if no tasks are available
+        // or return an empty function if the pool is stopping
+        QueuedTask queued = GetNextTask(worker, slot);
+
+        // An empty task signals that the worker should exit
+        // This happens when the pool is being destroyed and there are no more tasks
+        if (!queued.task)
+        {
+            break;
+        }
+
+        // At this point we've removed a task from the queue, so notify any
+        // producers that were waiting because the queue was full. The queue
+        // mutex is taken only while one is waiting: it closes the gap between
+        // the producer's check of the queue and its wait
+        if (0 != waitingProducers_)
+        {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex_);
+            }
+            queueNotFull_.notify_one();
+        }
+
+        // The clock is read only for the features that need the task's times
+        const bool    watched   = watchdogEnabled_.load(std::memory_order_relaxed);
+        const bool    accounted = IsWorkerTimeAccounted();
+        const bool    costed    = true == tagCosts_.load(std::memory_order_relaxed) && nullptr == slot.replaces;
+        const bool    measured  = true == accounted || true == costed || 0 != queued.trace.id;
+        const int64_t taskStart = (true == watched || true == measured) ? SteadyNanoseconds() : 0;
+
+        // Publish the task to the watchdog; the fence orders the tag after the end
+        // of the previous task, so a check that sees the new tag sees the new start
+        if (true == watched)
+        {
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.tag.store(queued.tag, std::memory_order_relaxed);
+            slot.startTime.store(taskStart, std::memory_order_release);
+        }
+
+        // Execute the task - this is done outside of any locks to allow maximum concurrency
+        currentTraceId = queued.trace.id;
+        THREADPOOL_PROBE2(task_start, worker, queued.tag);
+        RunTask(worker, nullptr == slot.replaces, queued);
+        THREADPOOL_PROBE2(task_end, worker, queued.tag);
 
-    // Wait until either:
-    // 1. The thread pool is being stopped (stop_ == true), or
-    // 2. There's at least one task available in the queue (tasks_.empty() == false)
-    // This predicate is checked whenever the condition variable is notified
-    condition_.wait(lock, [this] { return stop_ || tasks_.empty() == false; });
+        if (true == watched)
+        {
+            slot.startTime.store(0, std::memory_order_release);
+        }
+        if (true == measured)
+        {
+            const int64_t taskEnd = SteadyNanoseconds();
+            const int64_t arrival = std::chrono::duration_cast<std::chrono::nanoseconds>(queued.enqueueTime.time_since_epoch()).count();
+            if (true == accounted)
+            {
+                AddOwned(slot.runningTime, taskEnd - taskStart);
+                slot.tasks.store(slot.tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            if (true == costed)
+            {
+                AddTagCost(worker, queued.tag, taskEnd - taskStart, taskStart - arrival);
+            }
+            if (0 != queued.trace.id)
+            {
+                traceWriter_->Append(worker, TraceEvent {queued.trace.id, queued.trace.parent, arrival, taskStart, taskEnd - taskStart, queued.tag,
+                                                 static_cast<uint32_t>(worker)});
+            }
+        }
+
+        // Release the task's state before reporting completion, so that no task
+        // references its memory resource any more once WaitForAllTasks returns
+        queued.task = Task();
+
+        // After task execution, update our bookkeeping and potentially notify waiters
+        NotifyTaskCompletion();
+    }
 
-    // If the pool is stopping AND there are no tasks left to process,
-    // return an empty function to signal that the worker should exit
-    if (stop_ && tasks_.empty() == true)
+    if (nullptr != slot.replaces)
     {
-        return {}; // Return empty function to signal exit
+        replacementCount_--;
     }
+    slot.exited = true;
+}
 
-    // At this point, we know there's at least one task in the queue
-    // Move (instead of copy) the task from the queue to optimize performance
-    std::function<void()> task = std::move(tasks_.front());
-    tasks_.pop();
+ThreadPool::QueuedTask ThreadPool::GetNextTask(const size_t worker, WorkerSlot& slot)
+{
+    for (;;)
+    {
+        // A replacement that is no longer needed leaves the queue to the recovered worker.
+        // Both threads park on the same condition variable, so a wake-up meant for the
+        // worker may have reached the replacement - pass it on
+        if (true == IsReplacementRetired(slot))
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queues_[worker]->condition.notify_all();
+            return {};
+        }
 
-    // Increment the count of active tasks - this is used by WaitForAllTasks
-    // to know when all work is completed
-    activeTasks_++;
+        // Take a task from the own queue or steal one without touching the queue mutex
+        QueuedTask queued;
+        if (true == TakeTask(worker, queued))
+        {
+            // Feed the sojourn time of this task into the admission control law
+            const std::chrono::steady_clock::time_point now         = std::chrono::steady_clock::now();
+            const std::chrono::nanoseconds              sojournTime = std::chrono::duration_cast<std::chrono::nanoseconds>(now - queued.enqueueTime);
+            lastSojournTime_.store(sojournTime, std::memory_order_relaxed);
+            THREADPOOL_PROBE3(dequeue, worker, sojournTime.count(), queued.tag);
+#if defined(__linux__)
+            if (true == sharedStatsEnabled_.load(std::memory_order_relaxed))
+            {
+                // Only this thread writes its histogram, so a plain add suffices
+                const size_t           bucket  = std::min<size_t>(std::bit_width(static_cast<uint64_t>(std::max<int64_t>(sojournTime.count(), 0))), SojournBucketCount - 1);
+                std::atomic<uint64_t>& counter = slot.sojourn[bucket];
+                counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+#endif
+            if (true == admissionEnabled_.load(std::memory_order_relaxed))
+            {
+                UpdateAdmissionState(sojournTime, now);
+            }
+
+            return queued;
+        }
+
+        // A task arrived since the scan, or a producer or thief is just moving one;
+        // give it the processor instead of spinning on the queues
+        if (0 != TakeableTasks(worker))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // No task for this worker - lock the queue mutex to park
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        if (0 != TakeableTasks(worker))
+        {
+            continue;
+        }
+
+        // A retiring replacement is checked under the queue mutex, so the watchdog's
+        // wake-up cannot be missed; it loops back to the check above
+        if (true == IsReplacementRetired(slot))
+        {
+            continue;
+        }
+
+        // If the pool is stopping AND there are no tasks left to process,
+        // return an empty function to signal that the worker should exit
+        if (true == stop_)
+        {
+            return {}; // Return empty function to signal exit
+        }
+
+#if defined(__linux__)
+        // While file descriptors are watched, one idle worker blocks in epoll_wait
+        // instead of parking, and dispatches ready callbacks itself
+        if (watches_.empty() == false && false == polling_ && false == pollFailed_)
+        {
+            const bool    accounted = IsWorkerTimeAccounted();
+            const int64_t pollStart = (true == accounted) ? SteadyNanoseconds() : 0;
+            Task          dispatch  = PollFileDescriptors(lock, worker);
+            if (true == accounted)
+            {
+                AddOwned(slot.parkedTime, SteadyNanoseconds() - pollStart);
+            }
+            if (dispatch)
+            {
+                // Ready callbacks count as an active task for WaitForAllTasks
+                activeTasks_++;
+                return QueuedTask {std::move(dispatch), std::chrono::steady_clock::now(), 0, -1, Affinity::None, 0, nullptr, TraceIds {}};
+            }
+            continue;
+        }
+#endif
 
-    return task;
+        // Announce the worker as parked before the final check of the queues. Producers
+        // count a task before they look at parkedWorkers_, so either this check sees
+        // the task or the producer sees the parked worker and notifies it
+        const uint64_t idleBit = uint64_t(1) << (worker % 64);
+        parkedWorkers_++;
+        idleWorkers_[worker / 64].fetch_or(idleBit, std::memory_order_relaxed);
+        if (false == stop_ && 0 == TakeableTasks(worker))
+        {
+            THREADPOOL_PROBE1(worker_park, worker);
+            const bool    accounted = IsWorkerTimeAccounted();
+            const int64_t parkStart = (true == accounted) ? SteadyNanoseconds() : 0;
+            queues_[worker]->condition.wait(lock);
+            if (true == accounted)
+            {
+                AddOwned(slot.parkedTime, SteadyNanoseconds() - parkStart);
+            }
+            THREADPOOL_PROBE1(worker_unpark, worker);
+        }
+        idleWorkers_[worker / 64].fetch_and(~idleBit, std::memory_order_relaxed);
+        parkedWorkers_--;
+    }
 }
 
-void ThreadPool::NotifyTaskCompletion()
+void ThreadPool::RunTask(const size_t worker, const bool measured, QueuedTask& queued)
 {
-    // Lock the queue mutex to safely access shared state
-    std::unique_lock<std::mutex> lock(queueMutex_);
+#if defined(__linux__)
+    // The tables have a single writer, so replacements of stuck workers are not measured
+    if (true == measured && true == perfCounters_.load(std::memory_order_relaxed))
+    {
+        // Counters measure the thread that opens them, so every worker opens its own
+        if (nullptr == workerCounters)
+        {
+            workerCounters = std::make_unique<PerfCounterGroup>();
+            if (true == workerCounters->IsAvailable(PerfCounterGroup::Cycles))
+            {
+                hardwareCounters_ = true;
+            }
+        }
 
-    // Decrement the count of active tasks
-    activeTasks_--;
+        PerfCounterGroup::Values before;
+        PerfCounterGroup::Values after;
+        if (true == workerCounters->Read(before))
+        {
+            queued.task();
+            if (true == workerCounters->Read(after))
+            {
+                AddPerfCounts(worker, queued.tag,
+                    {1, after[PerfCounterGroup::Cycles] - before[PerfCounterGroup::Cycles],
+                        after[PerfCounterGroup::Instructions] - before[PerfCounterGroup::Instructions],
+                        after[PerfCounterGroup::CacheMisses] - before[PerfCounterGroup::CacheMisses],
+                        after[PerfCounterGroup::ContextSwitches] - before[PerfCounterGroup::ContextSwitches]});
+            }
+            return;
+        }
+    }
+#else
+    static_cast<void>(worker);
+    static_cast<void>(measured);
+#endif
 
-    // If there are no more tasks in the queue and no tasks currently executing,
-    // notify any threads that might be waiting for all work to complete
-    // This is primarily used by WaitForAllTasks
-    if (0 == activeTasks_ && tasks_.empty() == true)
+    queued.task();
+}
+
+void ThreadPool::AddPerfCounts(const size_t worker, const char* tag, const std::array<uint64_t, 5>& deltas)
+{
+    perfTables_[worker]->Add(tag, [&deltas](PerfCounterEntry& entry) {
+        for (size_t i = 0; i < deltas.size(); ++i)
+        {
+            entry.values[i].store(entry.values[i].load(std::memory_order_relaxed) + deltas[i], std::memory_order_relaxed);
+        }
+    });
+}
+
+ThreadPool::PerfCounterStatistics ThreadPool::GetPerfCounterStatistics() const
+{
+    PerfCounterStatistics statistics {hardwareCounters_.load(std::memory_order_relaxed), {}, {}};
+
+    const auto add = [](PerfCounts& counts, const PerfCounterEntry& entry) {
+        counts.tasks += entry.values[0].load(std::memory_order_relaxed);
+        counts.cycles += entry.values[1].load(std::memory_order_relaxed);
+        counts.instructions += entry.values[2].load(std::memory_order_relaxed);
+        counts.cacheMisses += entry.values[3].load(std::memory_order_relaxed);
+        counts.contextSwitches += entry.values[4].load(std::memory_order_relaxed);
+    };
+
+    for (const std::unique_ptr<PerfCounterTable>& table : perfTables_)
     {
-        finished_.notify_all();
+        PerfCounts total {};
+        table->ForEach([&statistics, &add, &total](const char* tag, const PerfCounterEntry& entry) {
+            auto match = std::find_if(statistics.tags.begin(), statistics.tags.end(), [tag](const TagPerfCounts& candidate) { return SameTag(candidate.tag, tag); });
+            if (statistics.tags.end() == match)
+            {
+                match = statistics.tags.insert(statistics.tags.end(), TagPerfCounts {tag, {}});
+            }
+            add(match->counts, entry);
+            add(total, entry);
+        });
+        statistics.workers.push_back(total);
     }
+    return statistics;
 }
 
-void ThreadPool::WaitForAllTasks()
+bool ThreadPool::SetPerformanceCounters(const bool enabled)
 {
-    // Lock the queue mutex to safely access shared state
-    std::unique_lock<std::mutex> lock(queueMutex_);
+    perfCounters_ = enabled;
 
-    // Wait until both conditions are true:
-    // 1. No more tasks in the queue, and
-    // 2. No tasks currently being executed by worker threads
-    // The predicate is checked when the condition variable is notified
-    // in NotifyTaskCompletion
-    finished_.wait(lock, [this] { return tasks_.empty() && 0 == activeTasks_; });
+#if defined(__linux__)
+    // Workers open their counters themselves; a probe on the calling thread tells what the kernel permits
+    return PerfCounterGroup().IsAvailable(PerfCounterGroup::Cycles);
+#else
+    return false;
+#endif
+}
 
-    // When this function returns, all tasks have completed,
-    // providing a synchronization point for the caller
+void ThreadPool::AddTagCost(const size_t worker, const char* tag, const int64_t runTime, const int64_t queueWait)
+{
+    tagCostTables_[worker]->Add(tag, [runTime, queueWait](TagCostEntry& entry) {
+        const auto store = [](std::atomic<int64_t>& value, const int64_t next) { value.store(next, std::memory_order_relaxed); };
+        store(entry.values[0], entry.values[0].load(std::memory_order_relaxed) + 1);
+        store(entry.values[1], entry.values[1].load(std::memory_order_relaxed) + runTime);
+        store(entry.values[2], std::max(entry.values[2].load(std::memory_order_relaxed), runTime));
+        store(entry.values[3], entry.values[3].load(std::memory_order_relaxed) + queueWait);
+        store(entry.values[4], std::max(entry.values[4].load(std::memory_order_relaxed), queueWait));
+    });
+}
+
+void ThreadPool::SetTagCostAccounting(const bool enabled)
+{
+    tagCosts_ = enabled;
+}
+
+ThreadPool::TagCostStatistics ThreadPool::GetTagCosts(const size_t top) const
+{
+    TagCostStatistics statistics {std::chrono::nanoseconds(0), {}, {}};
+    TagCost           other {OverflowTag, 0, std::chrono::nanoseconds(0), std::chrono::nanoseconds(0), std::chrono::nanoseconds(0), std::chrono::nanoseconds(0)};
+
+    const auto read = [](const char* tag, const TagCostEntry& entry) {
+        return TagCost {tag, static_cast<uint64_t>(entry.values[0].load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(entry.values[1].load(std::memory_order_relaxed)), std::chrono::nanoseconds(entry.values[2].load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(entry.values[3].load(std::memory_order_relaxed)), std::chrono::nanoseconds(entry.values[4].load(std::memory_order_relaxed))};
+    };
+    const auto merge = [](TagCost& total, const TagCost& cost) {
+        total.tasks += cost.tasks;
+        total.runTime += cost.runTime;
+        total.maxRunTime = std::max(total.maxRunTime, cost.maxRunTime);
+        total.queueWait += cost.queueWait;
+        total.maxQueueWait = std::max(total.maxQueueWait, cost.maxQueueWait);
+    };
+    const auto byRunTime = [](const TagCost& a, const TagCost& b) { return a.runTime > b.runTime; };
+
+    // Overflowed tags are kept apart, so that "(other)" always holds whatever did not make the report
+    const auto addTag = [&](const TagCost& cost) {
+        if (true == SameTag(cost.tag, OverflowTag))
+        {
+            merge(other, cost);
+            return;
+        }
+
+        auto match = std::find_if(statistics.tags.begin(), statistics.tags.end(), [&cost](const TagCost& candidate) { return SameTag(candidate.tag, cost.tag); });
+        if (statistics.tags.end() == match)
+        {
+            statistics.tags.push_back(cost);
+            return;
+        }
+        merge(*match, cost);
+    };
+
+    for (const std::unique_ptr<TagCostTable>& table : tagCostTables_)
+    {
+        std::vector<TagCost> worker;
+        table->ForEach([&worker, &read](const char* tag, const TagCostEntry& entry) { worker.push_back(read(tag, entry)); });
+
+        for (const TagCost& cost : worker)
+        {
+            statistics.runTime += cost.runTime;
+            addTag(cost);
+        }
+        std::sort(worker.begin(), worker.end(), byRunTime);
+        statistics.workers.push_back(std::move(worker));
+    }
+
+    std::sort(statistics.tags.begin(), statistics.tags.end(), byRunTime);
+    if (0 != top && statistics.tags.size() > top)
+    {
+        for (auto cost = statistics.tags.begin() + static_cast<std::ptrdiff_t>(top); cost != statistics.tags.end(); ++cost)
+        {
+            merge(other, *cost);
+        }
+        statistics.tags.resize(top);
+    }
+    if (0 != other.tasks)
+    {
+        statistics.tags.push_back(other);
+    }
+    return statistics;
+}
+
+bool ThreadPool::IsReplacementRetired(const WorkerSlot& slot)
+{
+    return nullptr != slot.replaces && slot.replaces->startTime.load(std::memory_order_acquire) != slot.replacedStart;
+}
+
+size_t ThreadPool::TakeableTasks(const size_t worker) const
+{
+    return stealableTasks_ + queues_[worker]->pinnedCount;
+}
+
+bool ThreadPool::TakeTask(const size_t worker, QueuedTask& queued)
+{
+    if (true == PopTask(*queues_[worker], true, queued))
+    {
+        if (Affinity::None != queued.affinity)
+        {
+            affinityTasks_.fetch_add(1, std::memory_order_relaxed);
+            affinityHits_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Steal within the own domain first, where the task's data may still be in the
+    // shared cache, then from the other domains in turn. Each domain is scanned from
+    // a random victim so that thieves spread out
+    const size_t home = queues_[worker]->domain;
+    for (size_t distance = 0; distance < domains_.size(); ++distance)
+    {
+        const WorkerDomain& domain = domains_[(home + distance) % domains_.size()];
+        const size_t        first  = NextRandom() % domain.queueCount;
+        for (size_t i = 0; i < domain.queueCount; ++i)
+        {
+            const size_t victim = domain.firstQueue + (first + i) % domain.queueCount;
+            if (victim != worker && true == PopTask(*queues_[victim], false, queued))
+            {
+                stolenTasks_.fetch_add(1, std::memory_order_relaxed);
+                if (0 != distance)
+                {
+                    remoteSteals_.fetch_add(1, std::memory_order_relaxed);
+                }
+                if (Affinity::None != queued.affinity)
+                {
+                    affinityTasks_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool ThreadPool::PopTask(WorkerQueue& queue, const bool owner, QueuedTask& queued)
+{
+    // Skip queues without a task for the caller without taking their lock
+    const size_t size = queue.size.load(std::memory_order_relaxed);
+    if (0 == size || (false == owner && size <= queue.pinnedCount.load(std::memory_order_relaxed)))
+    {
+        return false;
+    }
+
+    bool pinned = false;
+    {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+
+        // The owner takes the older of both fronts, so that pinned tasks keep their place in line
+        pinned = true == owner && queue.pinned.empty() == false &&
+                 (queue.tasks.empty() == true || queue.pinned.front().enqueueTime <= queue.tasks.front().enqueueTime);
+        std::pmr::deque<QueuedTask>& tasks = (true == pinned) ? queue.pinned : queue.tasks;
+        if (tasks.empty() == true)
+        {
+            return false;
+        }
+
+        // Move (instead of copy) the task from the queue to optimize performance
+        queued = std::move(tasks.front());
+        tasks.pop_front();
+        queue.size.store(queue.tasks.size() + queue.pinned.size(), std::memory_order_relaxed);
+    }
+
+    // Count the task as active before it leaves the queued counts, so that
+    // WaitForAllTasks never sees both counts at zero while the task is in flight
+    activeTasks_++;
+    queuedBytes_ -= queued.footprint;
+    if (true == pinned)
+    {
+        queue.pinnedCount--;
+    }
+    else
+    {
+        stealableTasks_--;
+    }
+    queuedTasks_--;
+    return true;
+}
+
+size_t ThreadPool::SelectQueue(const QueuedTask& task) const
+{
+    // A valid hint restricts the choice to the queues of its domain
+    size_t first = 0;
+    size_t count = queues_.size();
+    if (0 <= task.locality && static_cast<size_t>(task.locality) < domains_.size())
+    {
+        first = domains_[task.locality].firstQueue;
+        count = domains_[task.locality].queueCount;
+    }
+
+    // The same key always maps to the same worker, so its data stays in that worker's cache
+    if (Affinity::None != task.affinity)
+    {
+        return first + JumpConsistentHash(task.affinityKey, count);
+    }
+
+    // Work submitted by a worker stays local, where its data is still in the cache;
+    // idle workers steal it if the worker falls behind
+    if (this == currentWorker.pool && currentWorker.queue >= first && currentWorker.queue < first + count)
+    {
+        return currentWorker.queue;
+    }
+
+    if (1 == count)
+    {
+        return first;
+    }
+
+    // A parked worker picks the task up without waiting behind a backlog
+    const size_t idle = FindIdleWorker(first, count);
+    if (queues_.size() != idle)
+    {
+        return idle;
+    }
+
+    // Power of two choices: sampling two distinct queues and taking the shorter
+    // one keeps the longest queue within a small bound of the average, without
+    // scanning all queues. Stale sizes only cost balance, not correctness
+    const uint64_t random = NextRandom();
+    const size_t   one    = first + random % count;
+    size_t         other  = first + (random >> 32) % (count - 1);
+    if (other >= one)
+    {
+        other++;
+    }
+
+    return (queues_[other]->size.load(std::memory_order_relaxed) < queues_[one]->size.load(std::memory_order_relaxed)) ? other : one;
+}
+
+size_t ThreadPool::GetDomainCount() const
+{
+    return domains_.size();
+}
+
+int ThreadPool::CurrentDomain()
+{
+    return (nullptr != currentWorker.pool) ? static_cast<int>(currentWorker.domain) : -1;
+}
+
+void ThreadPool::NotifyTaskCompletion()
+{
+    // Decrement the count of active tasks; only the last active task has to check
+    // whether waiters must be notified
+    if (1 != activeTasks_.fetch_sub(1))
+    {
+        return;
+    }
+
+    // Lock the queue mutex so that the notification cannot slip in between the
+    // predicate check and the wait of WaitForAllTasks
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    // If there are no more tasks in the queues and no tasks currently executing,
+    // notify any threads that might be waiting for all work to complete
+    // This is primarily used by WaitForAllTasks
+    if (0 == activeTasks_ && 0 == queuedTasks_ && 0 == heldTasks_)
+    {
+        finished_.notify_all();
+    }
+}
+
+void ThreadPool::WaitForAllTasks()
+{
+    // Lock the queue mutex to safely access shared state
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    // Wait until both conditions are true:
+    // 1. No more tasks in the queues, and
+    // 2. No tasks currently being executed by worker threads, and
+    // 3. No tasks held back by rate-limited lanes
+    // The predicate is checked when the condition variable is notified
+    // in NotifyTaskCompletion
+    finished_.wait(lock, [this] { return 0 == queuedTasks_ && 0 == activeTasks_ && 0 == heldTasks_; });
+
+    // When this function returns, all tasks have completed,
+    // providing a synchronization point for the caller
+}
+
+void ThreadPool::SetAdmissionControl(const std::chrono::nanoseconds target, const std::chrono::nanoseconds interval)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    admissionTarget_   = target;
+    admissionInterval_ = interval;
+    admissionEnabled_  = 0 != target.count();
+
+    // Start over with a clean control state so that a previous configuration
+    // cannot keep the pool in the overloaded state
+    firstAboveTime_ = std::chrono::steady_clock::time_point {};
+    overloaded_     = false;
+
+    // Producers waiting on an overloaded pool may be able to proceed now
+    queueNotFull_.notify_all();
+}
+
+ThreadPool::Statistics ThreadPool::GetStatistics() const
+{
+    // Lock the queue mutex so that the lane and admission state belong to the same point in time
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    Statistics statistics;
+    statistics.queuedTasks     = queuedTasks_;
+    statistics.activeTasks     = activeTasks_;
+    statistics.overloaded      = overloaded_ && 0 != statistics.queuedTasks;
+    statistics.rejectedTasks   = rejectedTasks_;
+    statistics.lastSojournTime = lastSojournTime_;
+    statistics.queuedBytes     = queuedBytes_;
+    statistics.heldTasks       = heldTasks_;
+
+    statistics.unhandledExceptions = exceptionCount_.load(std::memory_order_relaxed);
+    statistics.deduplicatedTasks   = dedupHits_.load(std::memory_order_relaxed);
+    statistics.stolenTasks         = stolenTasks_.load(std::memory_order_relaxed);
+    statistics.remoteStolenTasks   = remoteSteals_.load(std::memory_order_relaxed);
+    statistics.affinityTasks       = affinityTasks_.load(std::memory_order_relaxed);
+    statistics.affinityHits        = affinityHits_.load(std::memory_order_relaxed);
+    statistics.stuckTasks          = stuckTasks_.load(std::memory_order_relaxed);
+    statistics.replacementWorkers  = replacementCount_.load(std::memory_order_relaxed);
+
+    // Recycling counters are only available if the pool allocates from a TaskMemoryResource.
+    // Note that the default instance is shared by all pools of the process
+    const TaskMemoryResource* recycler = dynamic_cast<const TaskMemoryResource*>(memoryResource_.load(std::memory_order_relaxed));
+    if (nullptr != recycler)
+    {
+        const TaskMemoryResource::Statistics recycling = recycler->GetStatistics();
+        statistics.recycledAllocations                 = recycling.recycledAllocations;
+        statistics.freshAllocations                    = recycling.freshAllocations;
+    }
+    else
+    {
+        statistics.recycledAllocations = 0;
+        statistics.freshAllocations    = 0;
+    }
+    return statistics;
+}
+
+bool ThreadPool::StartTraceRecording(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(traceMutex_);
+    if (true == tracing_)
+    {
+        return false;
+    }
+
+    if (nullptr == traceWriter_)
+    {
+        traceWriter_ = std::make_unique<TraceWriter>(queues_.size());
+    }
+
+    // Tasks submitted before the recording keep id zero; late events of an earlier
+    // recording have smaller ids and are dropped by the writer
+    if (false == traceWriter_->Start(path, nextTraceId_.load(), SteadyNanoseconds()))
+    {
+        return false;
+    }
+
+    // Submitters read the flag with acquire, so workers that run a recorded task see the writer
+    tracing_.store(true, std::memory_order_release);
+    return true;
+}
+
+bool ThreadPool::StopTraceRecording()
+{
+    std::unique_lock<std::mutex> lock(traceMutex_);
+    if (false == tracing_)
+    {
+        return false;
+    }
+
+    tracing_ = false;
+    return traceWriter_->Stop();
+}
+
+ThreadPool::TraceIds ThreadPool::NextTraceIds()
+{
+    if (false == tracing_.load(std::memory_order_acquire))
+    {
+        return TraceIds {0, 0};
+    }
+    return TraceIds {nextTraceId_.fetch_add(1, std::memory_order_relaxed), currentTraceId};
+}
+
+void ThreadPool::SetWorkerTimeAccounting(const bool enabled)
+{
+    workerTime_ = enabled;
+}
+
+bool ThreadPool::IsWorkerTimeAccounted() const
+{
+#if defined(__linux__)
+    if (true == sharedStatsEnabled_.load(std::memory_order_relaxed))
+    {
+        return true;
+    }
+#endif
+    return workerTime_.load(std::memory_order_relaxed);
+}
+
+std::vector<ThreadPool::WorkerStatistics> ThreadPool::GetWorkerStatistics() const
+{
+    const int64_t                 now = SteadyNanoseconds();
+    std::vector<WorkerStatistics> statistics;
+    statistics.reserve(workers_.size());
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        const WorkerSlot& slot        = *workerSlots_[i];
+        const int64_t     threadStart = slot.threadStart.load(std::memory_order_relaxed);
+
+        WorkerStatistics worker {};
+        worker.worker      = i;
+        worker.tasks       = slot.tasks.load(std::memory_order_relaxed);
+        worker.elapsedTime = std::chrono::nanoseconds((0 != threadStart) ? now - threadStart : 0);
+        worker.runningTime = std::chrono::nanoseconds(slot.runningTime.load(std::memory_order_relaxed));
+        worker.parkedTime  = std::chrono::nanoseconds(slot.parkedTime.load(std::memory_order_relaxed));
+
+#if defined(__linux__)
+        // The kernel keeps the remaining figures per thread; a worker that has not
+        // started yet has no thread id and reports zero
+        const int threadId = slot.threadId.load(std::memory_order_acquire);
+        if (0 != threadId)
+        {
+            timespec time {};
+            if (0 == clock_gettime(slot.cpuClock, &time))
+            {
+                worker.cpuTime = std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+            }
+            worker.runQueueTime = std::chrono::nanoseconds(ReadRunQueueTime(threadId));
+            ReadContextSwitches(threadId, worker.voluntaryContextSwitches, worker.involuntaryContextSwitches);
+        }
+#endif
+        statistics.push_back(worker);
+    }
+    return statistics;
+}
+
+void ThreadPool::SetMemoryBudget(const size_t maxQueuedBytes)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    maxQueuedBytes_ = maxQueuedBytes;
+
+    // A larger budget may unblock producers waiting in Enqueue
+    queueNotFull_.notify_all();
+}
+
+void ThreadPool::SetMemoryResource(std::pmr::memory_resource* resource)
+{
+    memoryResource_.store((nullptr != resource) ? resource : defaultResource_, std::memory_order_relaxed);
+}
+
+void ThreadPool::SetErrorHandler(ErrorHandler handler)
+{
+    std::shared_ptr<const ErrorHandler> sink;
+    if (handler)
+    {
+        sink = std::make_shared<const ErrorHandler>(std::move(handler));
+    }
+
+    std::unique_lock<std::mutex> lock(errorMutex_);
+    errorHandler_ = std::move(sink);
+}
+
+void ThreadPool::ReportException(std::exception_ptr exception, const char* tag) noexcept
+{
+    exceptionCount_.fetch_add(1, std::memory_order_relaxed);
+
+    // Invoke a reference to the handler outside the lock, so that the handler may
+    // replace itself and concurrent exceptions are not serialized
+    std::shared_ptr<const ErrorHandler> sink;
+    {
+        std::unique_lock<std::mutex> lock(errorMutex_);
+        sink = errorHandler_;
+    }
+
+    if (nullptr != sink)
+    {
+        try
+        {
+            (*sink)(std::move(exception), tag);
+        }
+        catch (...)
+        {
+            // The sink is the last receiver; its own exceptions are discarded
+        }
+    }
+}
+
+void ThreadPool::SetWatchdog(const std::chrono::nanoseconds threshold, WatchdogHandler handler, const bool elastic)
+{
+    std::unique_lock<std::mutex> lock(watchdogMutex_);
+    watchdogThreshold_ = std::max(threshold, std::chrono::nanoseconds(0));
+    watchdogHandler_   = std::move(handler);
+    watchdogElastic_   = elastic;
+    watchdogEnabled_   = (0 != watchdogThreshold_.count());
+
+    // The check reschedules itself; start it unless it is still running
+    if (true == watchdogEnabled_ && false == watchdogArmed_)
+    {
+        watchdogArmed_ = true;
+        ScheduleTimer(std::chrono::steady_clock::now() + std::max<std::chrono::nanoseconds>(watchdogThreshold_ / 2, std::chrono::milliseconds(1)),
+            [this] { CheckWatchdog(); });
+    }
+}
+
+void ThreadPool::CheckWatchdog()
+{
+    std::vector<StuckTask> reports;
+    std::vector<size_t>    retiring;
+    WatchdogHandler        handler;
+    {
+        std::unique_lock<std::mutex> lock(watchdogMutex_);
+        const int64_t now = SteadyNanoseconds();
+
+        // Join replacements that have left their work loop
+        for (auto replacement = replacements_.begin(); replacement != replacements_.end();)
+        {
+            if (true == replacement->slot->exited)
+            {
+                replacement->thread.join();
+                replacement = replacements_.erase(replacement);
+                continue;
+            }
+
+            // A replacement parked on the queue of its recovered worker has to be woken to exit
+            if (true == IsReplacementRetired(*replacement->slot))
+            {
+                retiring.push_back(replacement->slot->worker);
+            }
+            ++replacement;
+        }
+
+        // Report every task once; a start time read twice around the tag belongs to the same task as the tag
+        const auto check = [&](WorkerSlot& slot) {
+            const int64_t start = slot.startTime.load(std::memory_order_acquire);
+            const char*   tag   = slot.tag.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (0 == start || start != slot.startTime.load(std::memory_order_relaxed) || start == slot.reportedStart ||
+                now - start < watchdogThreshold_.count())
+            {
+                return;
+            }
+
+            slot.reportedStart = start;
+            stuckTasks_++;
+            reports.push_back(StuckTask {slot.worker, tag, std::chrono::nanoseconds(now - start)});
+
+            // The replacement serves the stuck worker's queue, including the tasks pinned to it
+            if (true == watchdogElastic_ && nullptr == slot.replaces && replacementCount_ < workers_.size())
+            {
+                replacementCount_++;
+                Replacement& replacement = replacements_.emplace_back(Replacement {std::make_unique<WorkerSlot>(slot.worker, &slot, start), std::thread()});
+                replacement.thread       = std::thread([this, &replacement] { RunWorker(replacement.slot->worker, *replacement.slot); });
+            }
+        };
+
+        if (0 != watchdogThreshold_.count())
+        {
+            for (const std::unique_ptr<WorkerSlot>& slot : workerSlots_)
+            {
+                check(*slot);
+            }
+            for (Replacement& replacement : replacements_)
+            {
+                check(*replacement.slot);
+            }
+        }
+
+        // Keep checking while enabled, and while replacements are left to retire and reap
+        watchdogArmed_ = (0 != watchdogThreshold_.count() || replacements_.empty() == false);
+        if (true == watchdogArmed_)
+        {
+            const std::chrono::nanoseconds period = (0 != watchdogThreshold_.count()) ? watchdogThreshold_ / 2 : std::chrono::milliseconds(100);
+            ScheduleTimer(std::chrono::steady_clock::now() + std::max<std::chrono::nanoseconds>(period, std::chrono::milliseconds(1)), [this] { CheckWatchdog(); });
+        }
+        handler = watchdogHandler_;
+    }
+
+    if (retiring.empty() == false)
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        for (const size_t worker : retiring)
+        {
+            queues_[worker]->condition.notify_all();
+        }
+        WakePoller();
+    }
+
+    if (nullptr != handler)
+    {
+        for (const StuckTask& report : reports)
+        {
+            try
+            {
+                handler(report);
+            }
+            catch (...)
+            {
+                // A failing handler must not take the timer thread down
+            }
+        }
+    }
+}
+
+#if defined(__linux__)
+bool ThreadPool::EnableSharedStats(const std::string& name, const std::chrono::nanoseconds interval)
+{
+    const std::string segmentName =
+        (name.empty() == false) ? name : SharedStatsSegment::NamePrefix + std::to_string(getpid()) + "." + std::to_string(sharedStatsSegments++);
+
+    const std::chrono::nanoseconds period = std::max<std::chrono::nanoseconds>(interval, std::chrono::milliseconds(1));
+
+    // The previous segment is removed first, as it may have the same name
+    std::unique_lock<std::mutex> lock(sharedStatsMutex_);
+    sharedStats_ = std::make_unique<SharedStatsSegment>();
+    if (false == sharedStats_->Create(segmentName, static_cast<uint32_t>(workers_.size()), period.count()))
+    {
+        sharedStatsEnabled_ = false;
+        sharedStats_.reset();
+        return false;
+    }
+
+    sharedStatsInterval_ = period;
+    sharedStatsEnabled_  = true;
+
+    // A publication that is already scheduled picks up the new segment
+    if (false == sharedStatsArmed_)
+    {
+        sharedStatsArmed_ = true;
+        ScheduleTimer(std::chrono::steady_clock::now(), [this] { PublishSharedStats(); });
+    }
+    return true;
+}
+
+void ThreadPool::DisableSharedStats()
+{
+    std::unique_lock<std::mutex> lock(sharedStatsMutex_);
+    sharedStatsEnabled_ = false;
+    sharedStats_.reset();
+}
+
+std::string ThreadPool::GetSharedStatsName() const
+{
+    std::unique_lock<std::mutex> lock(sharedStatsMutex_);
+    return (nullptr != sharedStats_) ? sharedStats_->Name() : std::string();
+}
+
+void ThreadPool::PublishSharedStats()
+{
+    static_assert(SojournBucketCount == SharedStatsBuckets, "the worker histograms are published bucket by bucket");
+
+    std::unique_lock<std::mutex> lock(sharedStatsMutex_);
+    if (nullptr == sharedStats_)
+    {
+        sharedStatsArmed_ = false;
+        return;
+    }
+
+    // The pool counters are read without the queueMutex_, so a publication never delays producers
+    SharedStatsSegment& segment = *sharedStats_;
+    SharedStatsHeader&  header  = segment.Header();
+    const size_t        queued  = queuedTasks_.load(std::memory_order_relaxed);
+    segment.BeginUpdate();
+    header.timestamp.store(SteadyNanoseconds(), std::memory_order_relaxed);
+    header.queuedTasks.store(queued, std::memory_order_relaxed);
+    header.activeTasks.store(activeTasks_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    header.parkedWorkers.store(parkedWorkers_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    header.overloaded.store((true == overloaded_.load(std::memory_order_relaxed) && 0 != queued) ? 1 : 0, std::memory_order_relaxed);
+    header.rejectedTasks.store(rejectedTasks_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    header.stolenTasks.store(stolenTasks_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    header.unhandledExceptions.store(exceptionCount_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    header.stuckTasks.store(stuckTasks_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    header.lastSojournTime.store(lastSojournTime_.load(std::memory_order_relaxed).count(), std::memory_order_relaxed);
+
+    std::array<uint64_t, SojournBucketCount> sojourn {};
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        const WorkerSlot&  slot  = *workerSlots_[i];
+        SharedStatsWorker& entry = segment.Worker(i);
+        entry.tasks.store(slot.tasks.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        entry.runningTime.store(slot.runningTime.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        entry.parkedTime.store(slot.parkedTime.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        entry.queueDepth.store(queues_[i]->size.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        timespec time {};
+        if (0 != slot.threadId.load(std::memory_order_acquire) && 0 == clock_gettime(slot.cpuClock, &time))
+        {
+            entry.cpuTime.store(static_cast<int64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec, std::memory_order_relaxed);
+        }
+
+        for (size_t bucket = 0; bucket < SojournBucketCount; ++bucket)
+        {
+            sojourn[bucket] += slot.sojourn[bucket].load(std::memory_order_relaxed);
+        }
+    }
+    for (size_t bucket = 0; bucket < SojournBucketCount; ++bucket)
+    {
+        header.sojourn[bucket].store(sojourn[bucket], std::memory_order_relaxed);
+    }
+    segment.EndUpdate();
+
+    ScheduleTimer(std::chrono::steady_clock::now() + sharedStatsInterval_, [this] { PublishSharedStats(); });
+}
+#endif
+
+ThreadPool::DedupShard& ThreadPool::DedupShardFor(const uint64_t key)
+{
+    // Keys are user hashes of unknown quality, so mix all bits into the shard index
+    constexpr uint64_t GoldenRatio = 0x9E3779B97F4A7C15ULL;
+    return dedupShards_[(key * GoldenRatio) >> (64 - std::countr_zero(DedupShardCount))];
+}
+
+void ThreadPool::ReleaseDedupKey(const uint64_t key)
+{
+    DedupShard&                  shard = DedupShardFor(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.entries.erase(key);
+}
+
+size_t ThreadPool::CreateRateLimitedLane(const double tasksPerSecond, const size_t burst)
+{
+    if (false == (tasksPerSecond > 0.0))
+    {
+        throw std::invalid_argument("rate-limited lane requires a positive rate");
+    }
+
+    auto lane            = std::make_unique<RateLimitedLane>();
+    lane->tasksPerSecond = tasksPerSecond;
+    lane->burst          = static_cast<double>(std::max<size_t>(burst, 1));
+    lane->tokens         = lane->burst; // A new lane starts with a full bucket
+    lane->lastRefill     = std::chrono::steady_clock::now();
+    lane->timerArmed     = false;
+
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    lanes_.push_back(std::move(lane));
+
+    // Lane ids are 1-based so that zero can select the task queue
+    return lanes_.size();
+}
+
+#if defined(__linux__)
+void ThreadPool::WatchFileDescriptor(const int fd, const uint32_t events, std::function<void(const uint32_t events)> callback)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    // Create the reactor on first use - pools that never watch a descriptor keep parking on the condition variable
+    if (epollFd_ < 0)
+    {
+        const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0)
+        {
+            throw std::system_error(errno, std::system_category(), "epoll_create1");
+        }
+
+        const int wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event wakeEvent {};
+        wakeEvent.events  = EPOLLIN;
+        wakeEvent.data.fd = wakeFd;
+        if (wakeFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) < 0)
+        {
+            const int error = errno;
+            if (wakeFd >= 0)
+            {
+                close(wakeFd);
+            }
+            close(epollFd);
+            throw std::system_error(error, std::system_category(), "eventfd");
+        }
+
+        epollFd_ = epollFd;
+        wakeFd_  = wakeFd;
+    }
+
+    // One-shot registration, re-armed after the callback ran, so that a callback
+    // never runs on two workers at the same time
+    epoll_event event {};
+    event.events  = events | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "epoll_ctl");
+    }
+
+    watches_[fd] = std::make_shared<FileWatch>(FileWatch {fd, events, std::move(callback)});
+
+    // Get an idle worker into epoll_wait if none is polling yet
+    if (false == polling_)
+    {
+        NotifyParkedWorker(0, queues_.size());
+    }
+}
+
+void ThreadPool::UnwatchFileDescriptor(const int fd)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    if (watches_.erase(fd) > 0)
+    {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+ThreadPool::Task ThreadPool::PollFileDescriptors(std::unique_lock<std::mutex>& lock, const size_t worker)
+{
+    // Block in epoll_wait without holding the queue mutex; new tasks wake us through the eventfd.
+    // As for parking, the queues are checked again after announcing the poller, since a
+    // producer that pushed before it saw polling_ does not write the eventfd
+    polling_ = true;
+    if (0 != TakeableTasks(worker))
+    {
+        polling_ = false;
+        return {};
+    }
+    lock.unlock();
+
+    epoll_event events[64];
+    int         count = 0;
+    do
+    {
+        count = epoll_wait(epollFd_, events, 64, -1);
+    }
+    while (count < 0 && EINTR == errno);
+
+    // A hard error would fail again at once and spin the worker; report it
+    // while the queue mutex is still released and give up the reactor
+    if (count < 0)
+    {
+        ReportException(std::make_exception_ptr(std::system_error(errno, std::system_category(), "epoll_wait")), nullptr);
+        lock.lock();
+        polling_    = false;
+        pollFailed_ = true;
+        return {};
+    }
+
+    lock.lock();
+    polling_ = false;
+
+    // Collect the watches that became ready; the wake eventfd only needs draining
+    std::vector<std::pair<std::shared_ptr<FileWatch>, uint32_t>> ready;
+    for (int i = 0; i < count; ++i)
+    {
+        if (events[i].data.fd == wakeFd_)
+        {
+            uint64_t value = 0;
+            while (read(wakeFd_, &value, sizeof(value)) > 0)
+            {
+            }
+            wakePending_ = false;
+            continue;
+        }
+
+        auto           watch       = watches_.find(events[i].data.fd);
+        const uint32_t readyEvents = events[i].events;
+        if (watch != watches_.end())
+        {
+            ready.emplace_back(watch->second, readyEvents);
+        }
+    }
+
+    // Hand the polling role to a parked worker while this one dispatches callbacks
+    if (ready.empty() == false)
+    {
+        NotifyParkedWorker(0, queues_.size());
+    }
+
+    if (ready.empty() == true)
+    {
+        return {};
+    }
+
+    return Task(memoryResource_.load(std::memory_order_relaxed), [this, ready = std::move(ready)]() {
+        for (const auto& [watch, readyEvents] : ready)
+        {
+            try
+            {
+                watch->callback(readyEvents);
+            }
+            catch (...)
+            {
+                // Like exceptions of TryEnqueue'd tasks, callback exceptions go to the error sink
+                ReportException(std::current_exception(), nullptr);
+            }
+
+            // Re-arm the descriptor unless it was unwatched or replaced in the meantime
+            std::unique_lock<std::mutex> watchLock(queueMutex_);
+            auto                         current = watches_.find(watch->fd);
+            if (current != watches_.end() && current->second == watch)
+            {
+                epoll_event event {};
+                event.events  = watch->events | EPOLLONESHOT;
+                event.data.fd = watch->fd;
+                epoll_ctl(epollFd_, EPOLL_CTL_MOD, watch->fd, &event);
+            }
+        }
+    });
+}
+#endif
+
+void ThreadPool::UpdateAdmissionState(const std::chrono::nanoseconds sojournTime, const std::chrono::steady_clock::time_point now)
+{
+    // Admission control is disabled, nothing to track
+    const std::chrono::nanoseconds target = admissionTarget_.load(std::memory_order_relaxed);
+    if (0 == target.count())
+    {
+        return;
+    }
+
+    // A task below the target or an empty queue means the standing queue has
+    // drained - leave the overloaded state and restart the interval
+    std::chrono::steady_clock::time_point firstAboveTime = firstAboveTime_.load(std::memory_order_relaxed);
+    if (sojournTime < target || 0 == queuedTasks_)
+    {
+        if (std::chrono::steady_clock::time_point {} != firstAboveTime)
+        {
+            firstAboveTime_.store({}, std::memory_order_relaxed);
+        }
+        if (true == overloaded_.load(std::memory_order_relaxed))
+        {
+            overloaded_.store(false, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    // First task above the target - give the queue one interval to drain
+    // before declaring overload, so that short bursts are absorbed. Only one
+    // of several workers dequeueing such tasks at once starts the interval
+    if (std::chrono::steady_clock::time_point {} == firstAboveTime)
+    {
+        firstAboveTime_.compare_exchange_strong(firstAboveTime, now + admissionInterval_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return;
+    }
+
+    // Every task dequeued during the whole interval was above the target,
+    // i.e. the minimum sojourn time exceeds the target
+    if (now >= firstAboveTime && false == overloaded_.load(std::memory_order_relaxed))
+    {
+        overloaded_.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool ThreadPool::IsQueueSaturated(const size_t footprint) const
+{
+    // An empty queue always admits new work - the overloaded state only matters
+    // while there is a standing queue, and a single task larger than the memory
+    // budget must still be able to run
+    const size_t queuedTasks = queuedTasks_;
+    if (0 == queuedTasks)
+    {
+        return 0 == maxQueueSize_;
+    }
+
+    if (queuedTasks >= maxQueueSize_ || true == overloaded_)
+    {
+        return true;
+    }
+
+    const size_t maxQueuedBytes = maxQueuedBytes_;
+    return 0 != maxQueuedBytes && queuedBytes_ + footprint > maxQueuedBytes;
+}
+
+bool ThreadPool::IsQueueSaturated(const size_t lane, const size_t footprint) const
+{
+    if (0 == lane)
+    {
+        return IsQueueSaturated(footprint);
+    }
+
+    // Tasks held by a lane are bounded by the lane's own length and the memory
+    // budget; admission control only applies to the task queue since the delay
+    // of a lane is intentional
+    const RateLimitedLane& rateLimitedLane = *lanes_[lane - 1];
+    if (rateLimitedLane.pending.empty() == true)
+    {
+        return 0 == maxQueueSize_;
+    }
+
+    if (rateLimitedLane.pending.size() >= maxQueueSize_)
+    {
+        return true;
+    }
+
+    const size_t maxQueuedBytes = maxQueuedBytes_;
+    return 0 != maxQueuedBytes && queuedBytes_ + footprint > maxQueuedBytes;
+}
+
+void ThreadPool::SubmitTask(const TaskOptions& options, const size_t footprint, Task&& task)
+{
+    // Lanes are protected by the queue mutex; the worker queues have their own locks,
+    // so for those the queue mutex is only taken if the producer has to wait
+    const size_t                 lane = options.lane;
+    std::unique_lock<std::mutex> lock(queueMutex_, std::defer_lock);
+    if (0 != lane)
+    {
+        lock.lock();
+        CheckLane(lane);
+    }
+
+    // Don't allow enqueueing after stopping the pool
+    if (true == stop_)
+    {
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    }
+
+    // If queue is full, over budget or overloaded, wait only briefly to avoid deadlock
+    if (true == IsQueueSaturated(lane, footprint))
+    {
+        WaitForQueueSpace(lock, lane, footprint);
+    }
+
+    // Add the task to its lane, or to a worker queue and notify one waiting worker
+    QueuedTask queued {std::move(task), std::chrono::steady_clock::now(), footprint, options.locality, options.affinity, options.affinityKey, options.tag, NextTraceIds()};
+    if (0 != lane)
+    {
+        HoldTask(std::move(queued), lane);
+        return;
+    }
+
+    if (true == lock.owns_lock())
+    {
+        lock.unlock();
+    }
+    PushTask(std::move(queued));
+}
+
+void ThreadPool::CheckLane(const size_t lane) const
+{
+    if (lane > lanes_.size())
+    {
+        throw std::invalid_argument("unknown rate-limited lane");
+    }
+}
+
+void ThreadPool::WaitForQueueSpace(std::unique_lock<std::mutex>& lock, const size_t lane, const size_t footprint)
+{
+    if (false == lock.owns_lock())
+    {
+        lock.lock();
+    }
+
+    // Workers only notify while a producer is registered as waiting; registering
+    // before the predicate check means a worker that frees space afterwards sees it
+    waitingProducers_++;
+    const std::chrono::steady_clock::time_point start   = std::chrono::steady_clock::now();
+    auto                                        timeout = std::chrono::milliseconds(100);
+    if (false == queueNotFull_.wait_for(lock, timeout, [this, lane, footprint] { return stop_ || false == IsQueueSaturated(lane, footprint); }))
+    {
+        // Timeout - queue still full, but don't block indefinitely
+        // This prevents deadlock while still providing some backpressure
+    }
+    waitingProducers_--;
+    THREADPOOL_PROBE2(enqueue_blocked, lane, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+void ThreadPool::PushTask(QueuedTask&& task)
+{
+    queuedBytes_ += task.footprint;
+    const bool   pinned = Affinity::Hard == task.affinity;
+    const size_t queue  = AddToWorkerQueue(std::move(task));
+
+    // Workers announce themselves before they check the queues a last time, so the
+    // queue mutex is only needed if a worker is parked or polling
+    if (0 != parkedWorkers_ || true == polling_)
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        NotifyTaskAvailable(queue, pinned);
+    }
+}
+
+size_t ThreadPool::AddToWorkerQueue(QueuedTask&& task)
+{
+    const size_t index  = SelectQueue(task);
+    WorkerQueue& queue  = *queues_[index];
+    const bool   pinned = Affinity::Hard == task.affinity;
+
+    // Counted before the push so that a worker popping the task cannot take the
+    // counts below zero; a worker that sees the count early retries until the task is there
+    const size_t depth = ++queuedTasks_;
+    const char*  tag   = task.tag;
+    if (true == pinned)
+    {
+        queue.pinnedCount++;
+    }
+    else
+    {
+        stealableTasks_++;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        ((true == pinned) ? queue.pinned : queue.tasks).push_back(std::move(task));
+        queue.size.store(queue.tasks.size() + queue.pinned.size(), std::memory_order_relaxed);
+    }
+
+    THREADPOOL_PROBE3(enqueue, index, depth, tag);
+    return index;
+}
+
+void ThreadPool::HoldTask(QueuedTask&& task, const size_t lane)
+{
+    queuedBytes_ += task.footprint;
+
+    // Hold the task in its lane and release whatever the token bucket allows
+    lanes_[lane - 1]->pending.push(std::move(task));
+    heldTasks_++;
+    ReleaseLaneTasks(lane);
+}
+
+void ThreadPool::ReleaseLaneTasks(const size_t lane)
+{
+    RateLimitedLane& rateLimitedLane = *lanes_[lane - 1];
+
+    // Refill the bucket for the time elapsed since the last refill
+    const std::chrono::steady_clock::time_point now     = std::chrono::steady_clock::now();
+    const double                                elapsed = std::chrono::duration<double>(now - rateLimitedLane.lastRefill).count();
+    rateLimitedLane.tokens                              = std::min(rateLimitedLane.burst, rateLimitedLane.tokens + elapsed * rateLimitedLane.tasksPerSecond);
+    rateLimitedLane.lastRefill                          = now;
+
+    // Release held tasks into the worker queues while tokens are available. The
+    // enqueue time is reset so that admission control only sees the time the
+    // task spends in the task queue, not the intentional delay of the lane
+    bool released = false;
+    while (rateLimitedLane.pending.empty() == false && rateLimitedLane.tokens >= 1.0)
+    {
+        rateLimitedLane.tokens -= 1.0;
+
+        QueuedTask task = std::move(rateLimitedLane.pending.front());
+        rateLimitedLane.pending.pop();
+        heldTasks_--;
+
+        task.enqueueTime = now;
+        const bool pinned = Affinity::Hard == task.affinity;
+        NotifyTaskAvailable(AddToWorkerQueue(std::move(task)), pinned);
+        released = true;
+    }
+
+    // Producers waiting for space in this lane may be able to proceed now
+    if (true == released)
+    {
+        queueNotFull_.notify_all();
+    }
+
+    // Arm a timer for the moment the next token becomes available, unless one is already pending
+    if (rateLimitedLane.pending.empty() == false && false == rateLimitedLane.timerArmed)
+    {
+        const std::chrono::duration<double> delay((1.0 - rateLimitedLane.tokens) / rateLimitedLane.tasksPerSecond);
+        rateLimitedLane.timerArmed = true;
+
+        ScheduleTimer(now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay), [this, lane] {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            lanes_[lane - 1]->timerArmed = false;
+            ReleaseLaneTasks(lane);
+        });
+    }
+}
+
+void ThreadPool::ScheduleTimer(const std::chrono::steady_clock::time_point deadline, std::function<void()> callback)
+{
+    std::unique_lock<std::mutex> lock(timerMutex_);
+
+    // The pool is being destroyed and the timer thread joined (or about to be) -
+    // starting a new one would leave it unjoined
+    if (true == timerStop_)
+    {
+        return;
+    }
+
+    // Start the timer thread on first use - pools without timers never pay for it
+    if (false == timerThread_.joinable())
+    {
+        timerThread_ = std::thread([this] { RunTimers(); });
+    }
+
+    timers_.push(Timer {deadline, std::move(callback)});
+
+    // Wake the timer thread in case the new timer is due before the current earliest one
+    timerCondition_.notify_one();
+}
+
+void ThreadPool::RunTimers()
+{
+    std::unique_lock<std::mutex> lock(timerMutex_);
+
+    while (false == timerStop_)
+    {
+        // Nothing scheduled - wait for a timer or shutdown
+        if (timers_.empty() == true)
+        {
+            timerCondition_.wait(lock, [this] { return timerStop_ || timers_.empty() == false; });
+            continue;
+        }
+
+        // Wait until the earliest timer is due; an earlier timer or shutdown wakes us up early
+        const std::chrono::steady_clock::time_point deadline = timers_.top().deadline;
+        if (std::chrono::steady_clock::now() < deadline)
+        {
+            timerCondition_.wait_until(lock, deadline);
+            continue;
+        }
+
+        // Run the callback outside of the timer mutex since it may schedule new timers
+        std::function<void()> callback = std::move(const_cast<Timer&>(timers_.top()).callback);
+        timers_.pop();
+
+        lock.unlock();
+        callback();
+        lock.lock();
+    }
+}
+
+void ThreadPool::NotifyTaskAvailable(const size_t queue, const bool pinned)
+{
+    // The owner of the queue is the cheapest to wake and keeps the task local
+    const uint64_t idleBit = uint64_t(1) << (queue % 64);
+    if (0 != (idleWorkers_[queue / 64].load(std::memory_order_relaxed) & idleBit))
+    {
+        NotifyParkedWorker(queue, 1);
+        return;
+    }
+
+    // Otherwise a parked worker of the same domain, then of any domain, steals the
+    // task. Only interrupt epoll_wait when the polling worker is the only idle one
+    const WorkerDomain& domain = domains_[queues_[queue]->domain];
+    if (false == pinned && (true == NotifyParkedWorker(domain.firstQueue, domain.queueCount) || true == NotifyParkedWorker(0, queues_.size())))
+    {
+        return;
+    }
+
+    WakePoller();
+}
+
+bool ThreadPool::NotifyParkedWorker(const size_t first, const size_t count)
+{
+    const size_t worker = FindIdleWorker(first, count);
+    if (queues_.size() == worker)
+    {
+        return false;
+    }
+
+    idleWorkers_[worker / 64].fetch_and(~(uint64_t(1) << (worker % 64)), std::memory_order_relaxed);
+    queues_[worker]->condition.notify_one();
+    return true;
+}
+
+size_t ThreadPool::FindIdleWorker(const size_t first, const size_t count) const
+{
+    // Scan [start, end) first and wrap around to [first, start)
+    const size_t end   = first + count;
+    const size_t start = first + NextRandom() % count;
+    const auto   scan  = [this](const size_t from, const size_t to) {
+        for (size_t word = from / 64; from < to && word <= (to - 1) / 64; ++word)
+        {
+            const uint64_t idle = idleWorkers_[word].load(std::memory_order_relaxed) & RangeMask(word, from, to);
+            if (0 != idle)
+            {
+                return word * 64 + std::countr_zero(idle);
+            }
+        }
+        return queues_.size();
+    };
+
+    const size_t worker = scan(start, end);
+    return (queues_.size() != worker) ? worker : scan(first, start);
+}
+
+void ThreadPool::WakePoller()
+{
+#if defined(__linux__)
+    if (true == polling_ && false == wakePending_)
+    {
+        const uint64_t value = 1;
+        if (write(wakeFd_, &value, sizeof(value)) == sizeof(value))
+        {
+            wakePending_ = true;
+        }
+    }
+#endif
+}
+
+ThreadPool::WorkerQueue::WorkerQueue(std::pmr::memory_resource* resource, const size_t queueDomain) :
+    tasks(resource), pinned(resource), size(0), pinnedCount(0), domain(queueDomain)
+{
+}
+
+std::pmr::memory_resource* ThreadPool::ResolveMemoryResource(const TaskOptions& options) const
+{
+    if (nullptr != options.memoryResource)
+    {
+        return options.memoryResource;
+    }
+
+    return memoryResource_.load(std::memory_order_relaxed);
+}
+
+ThreadPool::Task::Task(Task&& other) noexcept : node_(std::exchange(other.node_, nullptr))
+{
+}
+
+ThreadPool::Task& ThreadPool::Task::operator=(Task&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (nullptr != node_)
+        {
+            node_->Destroy();
+        }
+        node_ = std::exchange(other.node_, nullptr);
+    }
+    return *this;
+}
+
+ThreadPool::Task::~Task()
+{
+    // Destroying an unexecuted task releases its state, e.g. a promise whose
+    // future then reports a broken promise
+    if (nullptr != node_)
+    {
+        node_->Destroy();
+    }
+}
+
+ThreadPool::Task::operator bool() const noexcept
+{
+    return nullptr != node_;
+}
+
+void ThreadPool::Task::operator()()
+{
+    node_->Run();
 }
@@ -9,16 +9,35 @@
 #ifndef __THREAD_POOL_H_INCL__
 #define __THREAD_POOL_H_INCL__
 
+#include "ThreadPoolInvocation.h"
+#include "ThreadPoolMemoryResource.h"
+#include "ThreadPoolTopology.h"
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
 #include <functional>
 #include <future>
+#include <list>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
+#include <new>
 #include <queue>
+#include <string>
 #include <thread>
 #include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
 #include <vector>
 
+class IoUring;
+class SharedStatsSegment;
+class TraceWriter;
+
 ///
 /// \brief Thread pool that manages a collection of worker threads
 ///
@@ -37,9 +56,27 @@ public:
     ///
     /// \param threadCount Number of worker threads to create in the pool
     /// \param maxQueueSize Maximum size of the task queue (defaults to 10'000)
+    /// \param memoryResource Resource for the task queue and, unless overridden, task
+    ///        nodes and shared states (nullptr uses TaskMemoryResource::Default()).
+    ///        Must outlive the pool and every future obtained from it.
+    /// \throws std::system_error If thread creation fails
+    ///
+    ThreadPool(const size_t threadCount, const size_t maxQueueSize = 10'000, std::pmr::memory_resource* memoryResource = nullptr);
+
+    ///
+    /// \brief Constructs a hierarchical thread pool from a CPU topology
+    ///
+    /// Every domain of the topology becomes a sub-pool with one worker per CPU.
+    /// Workers are pinned to the CPUs of their domain (best effort), take tasks
+    /// submitted with a matching TaskOptions::locality first and steal from
+    /// workers of their own domain before they steal across domains.
+    ///
+    /// \param topology Domains and CPUs to create workers for
+    /// \param maxQueueSize Maximum size of the task queue (defaults to 10'000)
+    /// \param memoryResource Resource for the task queue and task nodes, as for the other constructor
     /// \throws std::system_error If thread creation fails
     ///
-    ThreadPool(const size_t threadCount, const size_t maxQueueSize = 10'000);
+    explicit ThreadPool(const CpuTopology& topology, const size_t maxQueueSize = 10'000, std::pmr::memory_resource* memoryResource = nullptr);
 
     ///
     /// \brief Destructor - stops all threads and waits for their completion
@@ -54,11 +91,66 @@ public:
     ThreadPool(const ThreadPool&)            = delete;
     ThreadPool& operator=(const ThreadPool&) = delete;
 
+    ///
+    /// \brief Routing of a task by TaskOptions::affinityKey
+    ///
+    enum class Affinity
+    {
+        None, ///< No affinity - the key is ignored
+        Soft, ///< Queue on the key's worker; idle workers may steal the task
+        Hard  ///< Queue on the key's worker; only that worker runs the task
+    };
+
+    ///
+    /// \brief Per-task submission options
+    ///
+    /// Passed as the first argument to the Enqueue and TryEnqueue overloads that
+    /// accept options. Members left at their defaults select the pool's default
+    /// behavior.
+    ///
+    struct TaskOptions
+    {
+        size_t                     footprint      = 0;              ///< Bytes charged against the memory budget (zero computes it from the captured callable and arguments)
+        size_t                     lane           = 0;              ///< Rate-limited lane returned by CreateRateLimitedLane (zero dispatches immediately)
+        std::pmr::memory_resource* memoryResource = nullptr;        ///< Resource for the task node and future shared state (nullptr uses the pool's resource)
+        const char*                tag            = nullptr;        ///< Name passed to the error handler and used to attribute performance counters and task costs (must outlive the pool, e.g. a string literal)
+        bool                       nothrow        = false;          ///< Task never throws: skip try/catch and exception capture (an exception calls std::terminate)
+        int                        locality       = -1;             ///< Preferred domain of a topology pool (-1 for none, out-of-range hints are ignored)
+        Affinity                   affinity       = Affinity::None; ///< Routing by affinityKey
+        uint64_t                   affinityKey    = 0;              ///< Key mapped to a worker by consistent hashing (within the locality domain, if given)
+    };
+
+    ///
+    /// \brief Receiver of exceptions thrown by fire-and-forget tasks
+    ///
+    /// Called on the worker that ran the task, with the exception and the task's
+    /// TaskOptions::tag (nullptr if untagged or for file descriptor callbacks).
+    ///
+    using ErrorHandler = std::function<void(std::exception_ptr exception, const char* tag)>;
+
+    ///
+    /// \brief Task reported by the watchdog for running longer than its threshold
+    ///
+    struct StuckTask
+    {
+        size_t                   worker;  ///< Index of the worker queue the thread serves
+        const char*              tag;     ///< TaskOptions::tag of the task (may be nullptr)
+        std::chrono::nanoseconds runTime; ///< Time the task had been running when it was reported
+    };
+
+    ///
+    /// \brief Receiver of watchdog reports, called on the pool's timer thread
+    ///
+    using WatchdogHandler = std::function<void(const StuckTask& task)>;
+
     ///
     /// \brief Enqueues a task to be executed by the thread pool
     ///
     /// This method accepts a callable object and its arguments, then wraps
     /// it in a task that will be executed by one of the worker threads.
+    /// The callable and its arguments are stored decayed and invoked once as
+    /// rvalues, so move-only callables and arguments (e.g. std::unique_ptr) are
+    /// handed over without copies. Use std::ref to pass a reference.
     /// If the queue is full, this method will block briefly and then add the task
     /// regardless of queue size to prevent deadlock.
     ///
@@ -69,7 +161,26 @@ public:
     /// \return std::future<return_type> A future that will hold the result of the task
     /// \throws std::runtime_error If the thread pool has been stopped
     ///
-    template<class F, class... Args> auto Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type>;
+    template<class F, class... Args>
+        requires(false == std::is_same_v<std::remove_cvref_t<F>, TaskOptions>)
+    auto Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>;
+
+    ///
+    /// \brief Enqueues a task with submission options
+    ///
+    /// Same as Enqueue, but the task is submitted with the given options.
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param options Submission options for this task
+    /// \param f The callable object to execute
+    /// \param args Arguments to pass to the callable object
+    /// \return std::future<return_type> A future that will hold the result of the task
+    /// \throws std::runtime_error If the thread pool has been stopped
+    /// \throws std::invalid_argument If TaskOptions::lane is not a lane of this pool
+    ///
+    template<class F, class... Args>
+    auto Enqueue(const TaskOptions& options, F&& f, Args&&... args) -> std::future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>;
 
     ///
     /// \brief Attempts to enqueue a task without blocking
@@ -84,7 +195,67 @@ public:
     /// \param args Arguments to pass to the callable object
     /// \return bool True if the task was enqueued, false if the queue was full or the pool was stopped
     ///
-    template<class F, class... Args> bool TryEnqueue(F&& f, Args&&... args);
+    template<class F, class... Args>
+        requires(false == std::is_same_v<std::remove_cvref_t<F>, TaskOptions>)
+    bool TryEnqueue(F&& f, Args&&... args);
+
+    ///
+    /// \brief Attempts to enqueue a task with submission options without blocking
+    ///
+    /// Same as TryEnqueue, but the task is submitted with the given options.
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param options Submission options for this task
+    /// \param f The callable object to execute
+    /// \param args Arguments to pass to the callable object
+    /// \return bool True if the task was enqueued, false if the queue was full or the pool was stopped
+    /// \throws std::invalid_argument If TaskOptions::lane is not a lane of this pool; unlike a
+    ///         full queue, an unknown lane is a programming error, so it is not reported as false
+    ///
+    template<class F, class... Args> bool TryEnqueue(const TaskOptions& options, F&& f, Args&&... args);
+
+    ///
+    /// \brief Enqueues a task unless an identical one is already queued or running
+    ///
+    /// Singleflight for expensive computations requested by many callers at
+    /// once: if a task submitted with the same key is still queued or running,
+    /// the caller receives a shared future of that task and nothing new is
+    /// scheduled. The key is released when the task finishes, just before its
+    /// result is published, so later callers start a fresh computation.
+    ///
+    /// The key must identify the computation (e.g. a hash of its inputs); a
+    /// running task whose result type differs is not shared.
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param key Identity of the computation
+    /// \param f The callable object to execute
+    /// \param args Arguments to pass to the callable object
+    /// \return std::shared_future<return_type> Future shared by all callers of the same in-flight key
+    /// \throws std::runtime_error If the thread pool has been stopped
+    ///
+    template<class F, class... Args>
+    auto EnqueueDedup(const uint64_t key, F&& f, Args&&... args) -> std::shared_future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>;
+
+    ///
+    /// \brief Enqueues a deduplicated task with submission options
+    ///
+    /// Same as EnqueueDedup; the options apply only if a new task is scheduled.
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param options Submission options for a newly scheduled task
+    /// \param key Identity of the computation
+    /// \param f The callable object to execute
+    /// \param args Arguments to pass to the callable object
+    /// \return std::shared_future<return_type> Future shared by all callers of the same in-flight key
+    /// \throws std::runtime_error If the thread pool has been stopped
+    /// \throws std::invalid_argument If TaskOptions::lane is not a lane of this pool
+    ///
+    template<class F, class... Args>
+    auto EnqueueDedup(const TaskOptions& options, const uint64_t key, F&& f, Args&&... args)
+        -> std::shared_future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>;
 
     ///
     /// \brief Blocks until all tasks are completed
@@ -95,124 +266,1533 @@ public:
     ///
     void WaitForAllTasks();
 
-private:
-    std::vector<std::thread>          workers_;      ///< Collection of worker threads
-    std::queue<std::function<void()>> tasks_;        ///< Queue of pending tasks
-    std::mutex                        queueMutex_;   ///< Mutex protecting the task queue
-    std::condition_variable           condition_;    ///< Condition variable for task availability
-    std::condition_variable           finished_;     ///< Condition variable for task completion
-    std::condition_variable           queueNotFull_; ///< Condition variable for queue space
-    std::atomic<bool>                 stop_;         ///< Flag indicating shutdown
-    std::atomic<size_t>               activeTasks_;  ///< Counter of currently executing tasks
-    const size_t                      maxQueueSize_; ///< Maximum number of pending tasks
+    ///
+    /// \brief Enables latency-targeted admission control for the task queue
+    ///
+    /// Every task is timestamped when it is enqueued and its sojourn time is
+    /// measured when a worker dequeues it. Once the sojourn time has stayed above
+    /// \p target for a full \p interval (i.e. the minimum sojourn time over the
+    /// interval exceeds the target), the pool is considered overloaded. While
+    /// overloaded, TryEnqueue rejects new tasks and Enqueue applies the same
+    /// bounded backpressure wait it uses for a full queue. The overloaded state
+    /// ends as soon as a task is dequeued below the target or the queue drains.
+    ///
+    /// This lets the effective queue length follow a latency budget rather than
+    /// a fixed task count. The maximum queue size still applies as a hard limit.
+    ///
+    /// \param target Acceptable queueing latency (a zero target disables admission control)
+    /// \param interval Time the sojourn time must stay above the target before tasks are rejected
+    ///
+    void SetAdmissionControl(const std::chrono::nanoseconds target, const std::chrono::nanoseconds interval = std::chrono::milliseconds(100));
 
     ///
-    /// \brief Signals all worker threads to stop processing
+    /// \brief Bounds the task queue by the bytes of captured state
     ///
-    /// This method sets the stop flag to true while holding the queue mutex,
-    /// which will cause worker threads to exit their processing loop once
-    /// they check the condition variable. It is called by the destructor.
+    /// Each queued task is charged its footprint: either the value passed in
+    /// TaskOptions::footprint, or the size of the decayed callable and arguments
+    /// it captures. Callables that own heap memory (buffers, containers) should
+    /// pass their real footprint explicitly. Enqueue and TryEnqueue apply the
+    /// same backpressure against the total queued bytes as against the maximum
+    /// queue size. A task is always admitted into an empty queue, so a single
+    /// task larger than the budget cannot stall the pool.
     ///
-    /// \note Thread safety: Must be called with queueMutex_ locked
+    /// \param maxQueuedBytes Maximum bytes of queued task state (zero disables the budget)
     ///
-    void SignalThreadsToStop();
+    void SetMemoryBudget(const size_t maxQueuedBytes);
 
     ///
-    /// \brief Retrieves the next task from the queue
+    /// \brief Sets the memory resource for task nodes and future shared states
     ///
-    /// This method handles the synchronization for worker threads waiting for
-    /// new tasks. It either returns the next task or an empty function if the
-    /// worker should exit (when the pool is stopping and the queue is empty).
+    /// Every submission allocates a task node and, for Enqueue, the shared state
+    /// of the returned future. Both come from TaskOptions::memoryResource if set,
+    /// otherwise from this pool-wide resource (initially the resource passed to
+    /// the constructor or TaskMemoryResource::Default(), which recycles blocks
+    /// through per-thread freelists). A batch can then be
+    /// allocated from an arena such as std::pmr::monotonic_buffer_resource and
+    /// released in one shot.
     ///
-    /// \return std::function<void()> Task function to be executed or empty function if worker should exit
-    /// \note Thread safety: Acquires and releases the queueMutex_
-    /// \note Blocks until a task is available or the pool is stopping
+    /// The resource must outlive all tasks and futures allocated from it, and
+    /// must tolerate deallocation from worker threads: a shared state is freed
+    /// by whichever thread releases it last. std::pmr::synchronized_pool_resource
+    /// qualifies, as does a monotonic_buffer_resource used by a single submitting
+    /// thread since its deallocation is a no-op.
     ///
-    std::function<void()> GetNextTask();
+    /// \param resource Memory resource to use (nullptr restores the constructor's resource)
+    ///
+    void SetMemoryResource(std::pmr::memory_resource* resource);
 
     ///
-    /// \brief Notifies that a task has been completed
+    /// \brief Creates a rate-limited submission lane
     ///
-    /// This method decrements the active task counter and notifies waiting threads
-    /// if all tasks have completed. It is called by worker threads after executing
-    /// a task.
+    /// Tasks submitted with TaskOptions::lane set to the returned id are held in
+    /// the lane's own queue and released into the task queue by a token bucket:
+    /// the bucket holds up to \p burst tokens, refills at \p tasksPerSecond and
+    /// every released task consumes one token. Releases are driven by the pool's
+    /// timer thread, so no worker sleeps on behalf of a throttled task and the
+    /// workers remain available for unthrottled work.
     ///
-    /// \note Thread safety: Acquires and releases the queueMutex_
+    /// Each lane holds at most as many tasks as the maximum queue size. Held
+    /// tasks are charged against the memory budget and awaited by WaitForAllTasks.
     ///
-    void NotifyTaskCompletion();
-};
+    /// \param tasksPerSecond Sustained release rate of the lane
+    /// \param burst Maximum number of tasks released back to back (at least one)
+    /// \return size_t Lane id to pass in TaskOptions::lane
+    /// \throws std::invalid_argument If the rate is not positive
+    ///
+    size_t CreateRateLimitedLane(const double tasksPerSecond, const size_t burst = 1);
 
-///
-/// \brief Template implementation of Enqueue method - must be in header
-///
-/// \note This implementation uses a packaged_task to handle the execution
-///       and capturing of the callable's result in a future object.
-///
-template<class F, class... Args> auto ThreadPool::Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<F, Args...>::type>
-{
-    using return_type = typename std::invoke_result<F, Args...>::type;
+    ///
+    /// \brief Sets the pool-level sink for unhandled exceptions
+    ///
+    /// Exceptions thrown by TryEnqueue'd tasks and file descriptor callbacks
+    /// have no future to carry them. They are counted in
+    /// Statistics::unhandledExceptions and passed to this handler together
+    /// with the task's tag. Exceptions thrown by the handler itself are
+    /// discarded. Tasks submitted with TaskOptions::nothrow bypass the sink.
+    ///
+    /// \param handler Handler to invoke (an empty handler only counts exceptions)
+    /// \note Thread safety: Acquires and releases the errorMutex_
+    ///
+    void SetErrorHandler(ErrorHandler handler);
+
+    ///
+    /// \brief Enables the watchdog for long-running and stuck tasks
+    ///
+    /// Every worker publishes the start time and tag of its current task in a
+    /// slot of its own. A check on the pool's timer thread, repeated every half
+    /// threshold, reports each task that has been running for longer than
+    /// \p threshold once: it is counted in Statistics::stuckTasks and passed to
+    /// \p handler. Exceptions thrown by the handler are discarded.
+    ///
+    /// In elastic mode the check also starts a replacement thread for the stuck
+    /// worker, so that a task spinning forever or blocked on a deadlock does not
+    /// take the worker's capacity - and the tasks pinned to it - with it. The
+    /// replacement serves the same worker queue and exits once the original
+    /// thread has finished the stuck task. At most as many replacements as
+    /// workers run at a time, and replacements are not replaced themselves.
+    ///
+    /// \param threshold Running time after which a task is reported (zero disables the watchdog)
+    /// \param handler Handler to invoke for every reported task (an empty handler only counts)
+    /// \param elastic True to start a replacement thread for every worker with a stuck task
+    /// \note Thread safety: Acquires and releases the watchdogMutex_
+    ///
+    void SetWatchdog(const std::chrono::nanoseconds threshold, WatchdogHandler handler = {}, const bool elastic = false);
+
+    ///
+    /// \brief Starts recording the tasks submitted from now on into a trace file
+    ///
+    /// For every recorded task the file holds its submission time, start time,
+    /// run duration, tag, worker and the task that submitted it (if it was
+    /// submitted from inside another recorded task). Workers append to buffers
+    /// of their own, which a background thread writes to the file every few
+    /// milliseconds. The format is described in ThreadPoolTrace.h; ReadTraceFile
+    /// reads it and the TraceReplay tool replays it against other pool
+    /// configurations.
+    ///
+    /// \param path File to create (truncated if it exists)
+    /// \return bool True if recording started, false if a recording is running or the file cannot be created
+    /// \note Thread safety: Acquires and releases the traceMutex_
+    ///
+    bool StartTraceRecording(const std::string& path);
 
-    // Create a packaged task that binds the function and args
-    auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    ///
+    /// \brief Stops the recording, writes the remaining records and closes the file
+    ///
+    /// Tasks still queued or running are not recorded any more.
+    ///
+    /// \return bool True if the trace was written completely, false on a write error or if no recording is running
+    /// \note Thread safety: Acquires and releases the traceMutex_
+    ///
+    bool StopTraceRecording();
 
-    std::future<return_type>     futureResult = task->get_future();
-    std::unique_lock<std::mutex> lock(queueMutex_);
+#if defined(__linux__)
+    ///
+    /// \brief Watches a file descriptor for readiness on the pool's workers
+    ///
+    /// Once a file descriptor is watched, one idle worker blocks in epoll_wait
+    /// instead of parking on the condition variable; the epoll set also contains
+    /// an eventfd through which new tasks wake it. When the descriptor becomes
+    /// ready, \p callback runs directly on that worker with the ready epoll
+    /// events, without a hop through a separate event-loop thread. Another idle
+    /// worker takes over polling in the meantime.
+    ///
+    /// Watches are one-shot internally and re-armed after the callback returns,
+    /// so a callback never runs concurrently with itself. Exceptions thrown by
+    /// the callback go to the error handler (see SetErrorHandler). If epoll_wait
+    /// fails (e.g. the epoll descriptor was closed behind the pool's back), a
+    /// std::system_error goes to the error handler and no callback runs any more.
+    ///
+    /// \param fd File descriptor to watch (must stay open until unwatched)
+    /// \param events epoll event mask, e.g. EPOLLIN or EPOLLOUT
+    /// \param callback Callback invoked with the ready events
+    /// \throws std::system_error If the descriptor cannot be added to the epoll set
+    ///
+    void WatchFileDescriptor(const int fd, const uint32_t events, std::function<void(const uint32_t events)> callback);
 
-    // Don't allow enqueueing after stopping the pool
-    if (true == stop_)
+    ///
+    /// \brief Stops watching a file descriptor
+    ///
+    /// A callback that is already running completes, but the descriptor is not
+    /// re-armed afterwards.
+    ///
+    /// \param fd File descriptor passed to WatchFileDescriptor
+    ///
+    void UnwatchFileDescriptor(const int fd);
+#endif
+
+    ///
+    /// \brief Returns the number of locality domains
+    ///
+    /// \return size_t Number of domains of the topology, or one for a pool constructed from a thread count
+    ///
+    size_t GetDomainCount() const;
+
+    ///
+    /// \brief Returns the domain of the calling worker
+    ///
+    /// Lets a task keep follow-up work in its domain by passing the result as
+    /// TaskOptions::locality.
+    ///
+    /// \return int Domain index of the calling worker thread, or -1 if the caller is not a pool worker
+    ///
+    static int CurrentDomain();
+
+    ///
+    /// \brief Performance counter totals of a set of tasks
+    ///
+    struct PerfCounts
     {
-        throw std::runtime_error("enqueue on stopped ThreadPool");
-    }
+        uint64_t tasks;           ///< Number of measured tasks
+        uint64_t cycles;          ///< CPU cycles in user space
+        uint64_t instructions;    ///< Instructions retired in user space
+        uint64_t cacheMisses;     ///< Last-level cache misses in user space
+        uint64_t contextSwitches; ///< Context switches of the worker while the tasks ran
+    };
 
-    // If queue is full, wait only briefly to avoid deadlock
-    if (tasks_.size() >= maxQueueSize_)
+    ///
+    /// \brief Performance counter totals of the tasks with one tag
+    ///
+    struct TagPerfCounts
     {
-        auto timeout = std::chrono::milliseconds(100);
-        if (false == queueNotFull_.wait_for(lock, timeout, [this] { return stop_ || tasks_.size() < maxQueueSize_; }))
-        {
-            // Timeout - queue still full, but don't block indefinitely
-            // This prevents deadlock while still providing some backpressure
-        }
-    }
+        const char* tag;    ///< TaskOptions::tag of the tasks (nullptr for untagged tasks and file descriptor callbacks)
+        PerfCounts  counts; ///< Totals over all workers
+    };
 
-    // Add the task to the queue and notify one waiting worker
-    tasks_.emplace([task]() { (*task)(); });
+    ///
+    /// \brief Snapshot of the performance counters of all measured tasks
+    ///
+    struct PerfCounterStatistics
+    {
+        bool                       hardwareCounters; ///< True if a worker could open the hardware counters (otherwise only context switches are counted)
+        std::vector<PerfCounts>    workers;          ///< Totals per worker, indexed in worker creation order
+        std::vector<TagPerfCounts> tags;             ///< Totals per tag, merged over all workers by tag name
+    };
 
-    condition_.notify_one();
-    return futureResult;
-}
+    ///
+    /// \brief Enables or disables per-task performance counters
+    ///
+    /// While enabled, every worker opens a perf_event_open counter group for
+    /// itself (see PerfCounterGroup) on its next task, reads it before and
+    /// after each task and adds the difference to its own table under the
+    /// task's TaskOptions::tag. The tables are written only by their worker
+    /// and read without locks by GetPerfCounterStatistics. With user-space
+    /// counter reads (rdpmc) a measurement costs a few dozen nanoseconds per
+    /// task, otherwise one read() system call before and after each task.
+    ///
+    /// Where the kernel refuses hardware counters (kernel.perf_event_paranoid,
+    /// no PMU) the pool still runs and counts tasks and context switches; the
+    /// other counts stay zero. Each worker keeps up to 64 distinct tags;
+    /// further tags are counted under "(other)". The counters of a worker
+    /// stay open until the pool is destroyed. Tasks run by replacement threads
+    /// of the watchdog are not measured.
+    ///
+    /// \param enabled True to measure tasks from now on, false to stop measuring
+    /// \return bool True if hardware counters are available, false if only context switches can be counted or the platform has no perf_event_open
+    ///
+    bool SetPerformanceCounters(const bool enabled);
 
-///
-/// \brief Non-blocking enqueue implementation - template must be in header
-///
-/// \note This implementation differs from Enqueue by never waiting when the
-///       queue is full, instead returning false immediately. Useful for
-///       implementing backpressure mechanisms.
-///
-template<class F, class... Args> bool ThreadPool::TryEnqueue(F&& f, Args&&... args)
-{
-    std::unique_lock<std::mutex> lock(queueMutex_);
+    ///
+    /// \brief Returns the performance counters of all tasks measured so far
+    ///
+    /// \return PerfCounterStatistics Totals per worker and per tag
+    /// \note Thread safety: Lock-free; totals of tasks that finish during the call may be partially included
+    ///
+    PerfCounterStatistics GetPerfCounterStatistics() const;
 
-    // Don't allow enqueueing after stopping the pool
-    if (true == stop_)
+    ///
+    /// \brief Run time and queue wait of the tasks with one tag
+    ///
+    struct TagCost
     {
-        return false;
-    }
+        const char*              tag;          ///< TaskOptions::tag of the tasks (nullptr for untagged tasks, "(other)" for the rest)
+        uint64_t                 tasks;        ///< Number of tasks run
+        std::chrono::nanoseconds runTime;      ///< Total wall time spent running them
+        std::chrono::nanoseconds maxRunTime;   ///< Longest run of one task
+        std::chrono::nanoseconds queueWait;    ///< Total time from submission until a worker started them
+        std::chrono::nanoseconds maxQueueWait; ///< Longest wait of one task
+    };
 
-    // If queue is full, return false immediately
-    if (tasks_.size() >= maxQueueSize_)
+    ///
+    /// \brief Snapshot of the per-tag cost attribution
+    ///
+    struct TagCostStatistics
     {
-        return false;
-    }
+        std::chrono::nanoseconds          runTime; ///< Total run time of all attributed tasks
+        std::vector<std::vector<TagCost>> workers; ///< Costs per tag of every worker, indexed in worker creation order
+        std::vector<TagCost>              tags;    ///< Costs per tag merged over all workers by tag name, by descending run time
+    };
+
+    ///
+    /// \brief Enables or disables the attribution of run time and queue wait to task tags
+    ///
+    /// While enabled, every worker adds the run time and queue wait of each task
+    /// to the entry of its TaskOptions::tag in a table of its own. A tag is
+    /// identified by its address, so tagging costs nothing at submission and
+    /// the accounting a few nanoseconds per task: one hash probe and a handful
+    /// of stores to a cache line only the worker writes. Each worker keeps up
+    /// to 64 distinct tags; further tags are counted under "(other)". Tasks run
+    /// by replacement threads of the watchdog are not attributed.
+    ///
+    /// \param enabled True to attribute tasks from now on, false to stop
+    ///
+    void SetTagCostAccounting(const bool enabled);
 
-    // Create and add packaged task
-    auto task = std::make_shared<std::packaged_task<void()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    ///
+    /// \brief Returns the costs attributed to every tag so far
+    ///
+    /// The per-worker tables are merged by tag name and sorted by total run
+    /// time, so the first entries are the task kinds that dominate worker time.
+    ///
+    /// \param top Number of merged tags to return (zero for all); the remaining ones are folded into "(other)"
+    /// \return TagCostStatistics Costs per worker and per tag
+    /// \note Thread safety: Lock-free; costs of tasks that finish during the call may be partially included
+    ///
+    TagCostStatistics GetTagCosts(const size_t top = 0) const;
 
-    tasks_.emplace([task]() { (*task)(); });
+    ///
+    /// \brief Snapshot of the pool's queue and admission state
+    ///
+    struct Statistics
+    {
+        size_t                   queuedTasks;         ///< Number of tasks waiting in the queue
+        size_t                   activeTasks;         ///< Number of tasks currently executing
+        bool                     overloaded;          ///< True if admission control currently rejects tasks
+        uint64_t                 rejectedTasks;       ///< Total number of tasks rejected by TryEnqueue
+        size_t                   queuedBytes;         ///< Bytes of task state currently charged against the memory budget
+        size_t                   heldTasks;           ///< Number of tasks held back by rate-limited lanes
+        uint64_t                 recycledAllocations; ///< Allocations of the pool's TaskMemoryResource served by recycling (process-wide for TaskMemoryResource::Default())
+        uint64_t                 freshAllocations;    ///< Allocations of the pool's TaskMemoryResource that needed a new block (process-wide for TaskMemoryResource::Default())
+        uint64_t                 unhandledExceptions; ///< Exceptions thrown by fire-and-forget tasks and callbacks
+        uint64_t                 deduplicatedTasks;   ///< EnqueueDedup calls that joined an in-flight task
+        uint64_t                 stolenTasks;         ///< Tasks a worker took from another worker's queue
+        uint64_t                 remoteStolenTasks;   ///< Stolen tasks that crossed a domain boundary
+        uint64_t                 affinityTasks;       ///< Dequeued tasks that were submitted with an affinity key
+        uint64_t                 affinityHits;        ///< Affinity tasks that ran on the key's worker (hit rate = affinityHits / affinityTasks)
+        uint64_t                 stuckTasks;          ///< Tasks the watchdog reported as running longer than its threshold
+        size_t                   replacementWorkers;  ///< Replacement threads currently standing in for stuck workers
+        std::chrono::nanoseconds lastSojournTime;     ///< Sojourn time of the most recently dequeued task
+    };
 
-    // Notify one worker thread that a task is available
-    condition_.notify_one();
-    return true;
+    ///
+    /// \brief Returns a snapshot of the pool's statistics
+    ///
+    /// Queue counters are maintained without the queueMutex_, so while producers
+    /// and workers are busy the values may belong to slightly different points in time.
+    ///
+    /// \return Statistics Current queue and admission state
+    /// \note Thread safety: Acquires and releases the queueMutex_
+    ///
+    Statistics GetStatistics() const;
+
+    ///
+    /// \brief Enables or disables the wall time accounting of the workers
+    ///
+    /// While enabled, every worker counts its tasks and reads the steady clock
+    /// around each task and each park to sum its running and parked time for
+    /// GetWorkerStatistics. The accounting is off by default, since it costs
+    /// two clock reads per task; while it is off, tasks, runningTime and
+    /// parkedTime stay at their last values. Publishing shared statistics
+    /// turns it on as well.
+    ///
+    /// \param enabled True to account from now on, false to stop
+    ///
+    void SetWorkerTimeAccounting(const bool enabled);
+
+    ///
+    /// \brief Time and scheduling accounting of one worker thread
+    ///
+    /// While SetWorkerTimeAccounting is enabled, the pool measures the wall time
+    /// its worker spends running tasks and parked in GetNextTask; the remainder
+    /// of elapsedTime went into finding work (scanning and stealing). CPU time, run-queue wait and context switches are
+    /// taken from the kernel:
+    ///
+    /// - cpuTime well below runningTime: tasks block (I/O, locks, page faults) or
+    ///   the thread is descheduled
+    /// - High runQueueTime or involuntaryContextSwitches: the CPUs are
+    ///   oversubscribed, the worker is ready but waits for a CPU
+    /// - High parkedTime on every worker: the pool has more threads than work
+    ///
+    struct WorkerStatistics
+    {
+        size_t                   worker;                     ///< Index of the worker
+        uint64_t                 tasks;                      ///< Number of tasks the worker ran
+        std::chrono::nanoseconds elapsedTime;                ///< Wall time since the worker started
+        std::chrono::nanoseconds runningTime;                ///< Wall time spent running tasks
+        std::chrono::nanoseconds parkedTime;                 ///< Wall time spent parked in GetNextTask or blocked in epoll_wait
+        std::chrono::nanoseconds cpuTime;                    ///< CPU time consumed by the thread (CLOCK_THREAD_CPUTIME_ID)
+        std::chrono::nanoseconds runQueueTime;               ///< Time the thread was runnable but waiting for a CPU (schedstat)
+        uint64_t                 voluntaryContextSwitches;   ///< Context switches because the thread blocked
+        uint64_t                 involuntaryContextSwitches; ///< Context switches because the thread was preempted
+    };
+
+    ///
+    /// \brief Returns the time and scheduling accounting of every worker
+    ///
+    /// The kernel figures are read from clock_gettime and /proc/self/task/<tid>,
+    /// so a call costs two file reads per worker; it is meant for periodic
+    /// sampling, not for every task. Replacement threads of the watchdog are not
+    /// included.
+    ///
+    /// \return std::vector<WorkerStatistics> Accounting per worker, indexed like the workers
+    /// \note Thread safety: Lock-free; the kernel figures are zero on platforms other than Linux
+    ///
+    std::vector<WorkerStatistics> GetWorkerStatistics() const;
+
+#if defined(__linux__)
+    ///
+    /// \brief Publishes the pool's counters into a POSIX shared-memory segment
+    ///
+    /// Every \p interval the timer thread copies the queue and admission counters,
+    /// a histogram of the sojourn times, and per worker the tasks run, running,
+    /// parked and CPU time and the queue depth into the segment (layout in
+    /// ThreadPoolSharedStats.h). Updates are protected by a seqlock, so other
+    /// processes such as the tp-top tool read consistent copies without ever
+    /// blocking the pool. The segment is removed when publishing is disabled or
+    /// the pool is destroyed.
+    ///
+    /// Calling it again replaces the segment; if the new one cannot be created,
+    /// publishing stops. Workers only count their sojourn times and account
+    /// their time (see SetWorkerTimeAccounting) while publishing is enabled.
+    ///
+    /// \param name Name for shm_open, starting with a slash (empty for "/threadpool.<pid>.<n>")
+    /// \param interval Publishing interval
+    /// \return bool True if the segment was created
+    /// \note Thread safety: Acquires and releases the sharedStatsMutex_
+    ///
+    bool EnableSharedStats(const std::string& name = {}, const std::chrono::nanoseconds interval = std::chrono::milliseconds(100));
+
+    ///
+    /// \brief Stops publishing and removes the segment
+    ///
+    /// \note Thread safety: Acquires and releases the sharedStatsMutex_
+    ///
+    void DisableSharedStats();
+
+    ///
+    /// \brief Returns the name of the published segment
+    ///
+    /// \return std::string Name passed to shm_open (empty while publishing is disabled)
+    /// \note Thread safety: Acquires and releases the sharedStatsMutex_
+    ///
+    std::string GetSharedStatsName() const;
+#endif
+
+private:
+    // Reports exceptions of the completions it runs on its poller thread
+    friend class IoUring;
+
+    ///
+    /// \brief Move-only type-erased task allocated from a memory resource
+    ///
+    /// Replaces std::function for queued work so that the callable, including
+    /// move-only state such as a promise, is stored in a single node allocated
+    /// from a std::pmr::memory_resource instead of global operator new.
+    ///
+    class Task
+    {
+    public:
+        Task() = default;
+
+        ///
+        /// \brief Allocates a node for the callable from the given resource
+        ///
+        /// \param resource Memory resource for the node, must outlive the task
+        /// \param callable Callable to store, invoked without arguments
+        ///
+        template<class Callable> Task(std::pmr::memory_resource* resource, Callable&& callable);
+
+        Task(Task&& other) noexcept;
+        Task& operator=(Task&& other) noexcept;
+        ~Task();
+
+        // Delete copy constructor and assignment operator
+        Task(const Task&)            = delete;
+        Task& operator=(const Task&) = delete;
+
+        ///
+        /// \brief Checks whether the task holds a callable
+        ///
+        explicit operator bool() const noexcept;
+
+        ///
+        /// \brief Invokes the stored callable
+        ///
+        void operator()();
+
+    private:
+        ///
+        /// \brief Type-erased node interface
+        ///
+        struct Node
+        {
+            virtual void Run()              = 0;
+            virtual void Destroy() noexcept = 0; ///< Destroys the node and returns its storage to its resource
+
+        protected:
+            ~Node() = default;
+        };
+
+        ///
+        /// \brief Node storing a concrete callable
+        ///
+        template<class Callable> struct CallableNode final : Node
+        {
+            std::pmr::memory_resource* resource; ///< Resource the node was allocated from
+            Callable                   callable; ///< Stored callable
+
+            CallableNode(std::pmr::memory_resource* nodeResource, Callable&& nodeCallable);
+            void Run() override;
+            void Destroy() noexcept override;
+        };
+
+        Node* node_ = nullptr; ///< Owned node, or nullptr if empty
+    };
+
+    ///
+    /// \brief Ids of a task in the trace recording
+    ///
+    struct TraceIds
+    {
+        uint64_t id;     ///< Id of the task (zero if it is not recorded)
+        uint64_t parent; ///< Id of the recorded task that submitted it (zero for none)
+    };
+
+    ///
+    /// \brief Entry of the task queue
+    ///
+    struct QueuedTask
+    {
+        Task                                  task;        ///< Task to execute
+        std::chrono::steady_clock::time_point enqueueTime; ///< Time at which the task entered the queue
+        size_t                                footprint;   ///< Bytes charged against the memory budget
+        int                                   locality;    ///< Preferred domain (-1 for none)
+        Affinity                              affinity;    ///< Routing by affinityKey
+        uint64_t                              affinityKey; ///< Key mapped to the preferred worker
+        const char*                           tag;         ///< TaskOptions::tag of the task (may be nullptr)
+        TraceIds                              trace;       ///< Ids of the task in the trace recording
+    };
+
+    ///
+    /// \brief Task queue of one worker, on its own cache line
+    ///
+    /// Producers push to the back, the owning worker and thieves pop from the
+    /// front, so tasks of one queue keep their submission order. Tasks with hard
+    /// affinity wait in a separate deque that thieves do not touch.
+    ///
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex                  mutex;       ///< Mutex protecting the queue
+        std::pmr::deque<QueuedTask> tasks;       ///< Pending tasks any worker may take
+        std::pmr::deque<QueuedTask> pinned;      ///< Pending tasks only the owning worker may take
+        std::atomic<size_t>         size;        ///< Number of tasks in both deques, read without the mutex to pick a queue
+        std::atomic<size_t>         pinnedCount; ///< Number of pinned tasks, counted before they are pushed
+        std::condition_variable     condition;   ///< Condition variable the owning worker parks on
+        const size_t                domain;      ///< Domain of the owning worker
+
+        WorkerQueue(std::pmr::memory_resource* resource, const size_t queueDomain);
+    };
+
+    ///
+    /// \brief Workers of one locality domain
+    ///
+    /// The queues of a domain are contiguous in queues_.
+    ///
+    struct WorkerDomain
+    {
+        size_t                firstQueue; ///< Index of the domain's first queue
+        size_t                queueCount; ///< Number of queues (and workers) of the domain
+        std::vector<unsigned> cpus;       ///< CPUs the domain's workers are pinned to (empty for no pinning)
+    };
+
+    ///
+    /// \brief Token bucket and backlog of a rate-limited lane
+    ///
+    struct RateLimitedLane
+    {
+        double                                tasksPerSecond; ///< Token refill rate
+        double                                burst;          ///< Capacity of the token bucket
+        double                                tokens;         ///< Tokens currently available
+        std::chrono::steady_clock::time_point lastRefill;     ///< Time of the last token refill
+        std::queue<QueuedTask>                pending;        ///< Tasks waiting for a token
+        bool                                  timerArmed;     ///< True while a release timer is scheduled
+    };
+
+    ///
+    /// \brief File descriptor watched by the reactor
+    ///
+    struct FileWatch
+    {
+        int                                        fd;       ///< Watched file descriptor
+        uint32_t                                   events;   ///< Requested epoll events
+        std::function<void(const uint32_t events)> callback; ///< Readiness callback
+    };
+
+    ///
+    /// \brief Result of a task submitted by EnqueueDedup, shared by the task and every caller that joins it
+    ///
+    /// Allocated in one block from the task's memory resource, like the
+    /// promise's shared state.
+    ///
+    template<class R> struct DedupFlight
+    {
+        std::promise<R>       promise; ///< Promise fulfilled by the task
+        std::shared_future<R> future;  ///< Future handed to the callers
+
+        explicit DedupFlight(const std::pmr::polymorphic_allocator<char>& allocator) :
+            promise(std::allocator_arg, allocator), future(promise.get_future().share())
+        {
+        }
+    };
+
+    ///
+    /// \brief In-flight task registered by EnqueueDedup
+    ///
+    struct DedupEntry
+    {
+        const std::type_info* type;   ///< Result type of the task
+        std::shared_ptr<void> flight; ///< DedupFlight of the task's result type
+    };
+
+    ///
+    /// \brief Shard of the in-flight table, on its own cache line
+    ///
+    struct alignas(64) DedupShard
+    {
+        std::mutex                               mutex;   ///< Mutex protecting the shard
+        std::unordered_map<uint64_t, DedupEntry> entries; ///< In-flight tasks by key
+    };
+
+    static constexpr size_t DedupShardCount = 16; ///< Number of in-flight table shards (a power of two)
+
+    static constexpr size_t TagTableSize = 64; ///< Number of tags each worker keeps apart in a TagTable (a power of two)
+
+    ///
+    /// \brief Per-tag totals of one worker, on its own cache lines
+    ///
+    /// Only the owning worker claims and updates entries, so updates need no
+    /// locked instructions; the atomics merely keep concurrent snapshots
+    /// well-defined. An entry's totals are stored before its tag is published,
+    /// so a reader that sees the tag sees valid totals.
+    ///
+    /// \tparam Entry Totals of one tag: an atomic tag and an array of atomic values whose first element counts the tasks
+    ///
+    template<class Entry> struct alignas(64) TagTable
+    {
+        std::array<Entry, TagTableSize> entries;  ///< Open-addressed entries, keyed by tag address
+        Entry                           untagged; ///< Tasks without a tag
+        Entry                           overflow; ///< Tasks whose tag found no free entry
+
+        ///
+        /// \brief Applies an update to the entry of a tag, claiming a free entry if the tag is new
+        ///
+        /// \param tag Tag of the task (nullptr for untagged tasks)
+        /// \param update Called with the entry to add to
+        /// \note Thread safety: Must only be called by the owning worker
+        ///
+        template<class Update> void Add(const char* tag, Update update);
+
+        ///
+        /// \brief Calls visit(tag, entry) for every entry that holds tasks
+        ///
+        /// \param visit Called with the tag (nullptr for untagged tasks, "(other)" for the overflow) and the entry
+        /// \note Thread safety: Lock-free; may run concurrently with the owning worker's updates
+        ///
+        template<class Visit> void ForEach(Visit visit) const;
+    };
+
+    ///
+    /// \brief Performance counter totals of one tag on one worker
+    ///
+    struct PerfCounterEntry
+    {
+        std::atomic<const char*>             tag;    ///< Tag of the entry (nullptr while the slot is free)
+        std::array<std::atomic<uint64_t>, 5> values; ///< Tasks, cycles, instructions, cache misses and context switches
+    };
+
+    ///
+    /// \brief Cost totals of one tag on one worker
+    ///
+    struct TagCostEntry
+    {
+        std::atomic<const char*>            tag;    ///< Tag of the entry (nullptr while the slot is free)
+        std::array<std::atomic<int64_t>, 5> values; ///< Tasks, run time, maximum run time, queue wait and maximum queue wait
+    };
+
+    using PerfCounterTable = TagTable<PerfCounterEntry>; ///< Performance counters of one worker
+    using TagCostTable     = TagTable<TagCostEntry>;     ///< Tag costs of one worker
+
+    ///
+    /// \brief Number of sojourn time histogram buckets per worker (SharedStatsBuckets)
+    ///
+    static constexpr size_t SojournBucketCount = 40;
+
+    using SojournHistogram = std::array<std::atomic<uint64_t>, SojournBucketCount>; ///< Sojourn time histogram of one worker
+
+    ///
+    /// \brief Current task and time accounting of one worker thread, on its own cache line
+    ///
+    /// The task is published around every task while the watchdog is enabled and
+    /// read by the watchdog check. The accounting is written by its thread only
+    /// and read by GetWorkerStatistics.
+    ///
+    struct alignas(64) WorkerSlot
+    {
+        std::atomic<int64_t>     startTime;     ///< steady_clock nanoseconds at which the current task started (zero while idle)
+        std::atomic<const char*> tag;           ///< Tag of the current task
+        std::atomic<bool>        exited;        ///< True once the thread has left its work loop
+        const size_t             worker;        ///< Index of the worker queue the thread serves
+        const WorkerSlot*        replaces;      ///< Slot of the stuck worker a replacement stands in for (nullptr for regular workers)
+        const int64_t            replacedStart; ///< Start time of the stuck task the replacement waits for
+        int64_t                  reportedStart; ///< Start time of the last task reported (used by the check only)
+        std::atomic<int>         threadId;      ///< Kernel thread id (zero until the thread runs, or if the platform has none)
+        std::atomic<int64_t>     threadStart;   ///< steady_clock nanoseconds at which the thread entered its work loop
+        std::atomic<uint64_t>    tasks;         ///< Number of tasks run
+        std::atomic<int64_t>     runningTime;   ///< Nanoseconds spent running tasks
+        std::atomic<int64_t>     parkedTime;    ///< Nanoseconds spent parked or blocked in epoll_wait
+#if defined(__linux__)
+        clockid_t                cpuClock;      ///< CPU-time clock of the thread, set by the thread before its threadId
+        SojournHistogram         sojourn;       ///< Sojourn time histogram of the dequeued tasks (while shared stats are enabled)
+#endif
+
+        WorkerSlot(const size_t slotWorker, const WorkerSlot* slotReplaces, const int64_t slotReplacedStart);
+    };
+
+    ///
+    /// \brief Thread started by the watchdog in place of a stuck worker
+    ///
+    struct Replacement
+    {
+        std::unique_ptr<WorkerSlot> slot;   ///< Slot of the replacement thread
+        std::thread                 thread; ///< Replacement thread
+    };
+
+    ///
+    /// \brief Callback scheduled on the pool's timer thread
+    ///
+    struct Timer
+    {
+        std::chrono::steady_clock::time_point deadline; ///< Time at which the callback becomes due
+        std::function<void()>                 callback; ///< Callback to run on the timer thread
+
+        bool operator>(const Timer& other) const
+        {
+            return deadline > other.deadline;
+        }
+    };
+
+    std::vector<std::thread>                                            workers_;           ///< Collection of worker threads
+    std::pmr::memory_resource* const                                    defaultResource_;   ///< Resource passed to the constructor (or the default)
+    std::vector<std::unique_ptr<WorkerQueue>>                           queues_;            ///< Task queues, one per worker (at least one)
+    std::vector<WorkerDomain>                                           domains_;           ///< Locality domains (at least one)
+    std::unique_ptr<std::atomic<uint64_t>[]>                            idleWorkers_;       ///< Bitmap of parked workers, indexed like queues_
+    std::atomic<size_t>                                                 queuedTasks_;       ///< Number of tasks in all worker queues
+    std::atomic<size_t>                                                 stealableTasks_;    ///< Number of queued tasks without hard affinity
+    std::atomic<uint64_t>                                               stolenTasks_;       ///< Number of tasks taken from another worker's queue
+    std::atomic<uint64_t>                                               remoteSteals_;      ///< Number of stolen tasks that crossed a domain boundary
+    std::atomic<uint64_t>                                               affinityTasks_;     ///< Number of dequeued tasks with an affinity key
+    std::atomic<uint64_t>                                               affinityHits_;      ///< Number of affinity tasks run by the key's worker
+    mutable std::mutex                                                  queueMutex_;        ///< Mutex protecting lanes, admission configuration, parking and the reactor
+    std::condition_variable                                             finished_;          ///< Condition variable for task completion
+    std::condition_variable                                             queueNotFull_;      ///< Condition variable for queue space
+    std::atomic<bool>                                                   stop_;              ///< Flag indicating shutdown
+    std::atomic<size_t>                                                 activeTasks_;       ///< Counter of currently executing tasks
+    const size_t                                                        maxQueueSize_;      ///< Maximum number of pending tasks
+    std::atomic<std::chrono::nanoseconds>                               admissionTarget_;   ///< Target sojourn time (zero if admission control is disabled)
+    std::atomic<std::chrono::nanoseconds>                               admissionInterval_; ///< Interval the sojourn time must exceed the target
+    std::atomic<std::chrono::steady_clock::time_point>                  firstAboveTime_;    ///< Deadline after which a sojourn above target signals overload
+    std::atomic<std::chrono::nanoseconds>                               lastSojournTime_;   ///< Sojourn time of the most recently dequeued task
+    std::atomic<bool>                                                   admissionEnabled_;  ///< True if admission control is configured (read without the queueMutex_)
+    std::atomic<bool>                                                   overloaded_;        ///< True while admission control rejects tasks
+    std::atomic<uint64_t>                                               rejectedTasks_;     ///< Number of tasks rejected by TryEnqueue
+    std::atomic<size_t>                                                 maxQueuedBytes_;    ///< Maximum bytes of queued task state (zero if unbounded)
+    std::atomic<size_t>                                                 queuedBytes_;       ///< Bytes of task state currently queued or held
+    std::atomic<size_t>                                                 waitingProducers_;  ///< Number of producers blocked in Enqueue waiting for space
+    std::vector<std::unique_ptr<RateLimitedLane>>                       lanes_;             ///< Rate-limited lanes, indexed by lane id - 1
+    size_t                                                              heldTasks_;         ///< Number of tasks held in rate-limited lanes
+    std::thread                                                         timerThread_;       ///< Timer thread, started on first use
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;            ///< Pending timers ordered by deadline
+    std::mutex                                                          timerMutex_;        ///< Mutex protecting the timer queue
+    std::condition_variable                                             timerCondition_;    ///< Condition variable for timer changes
+    bool                                                                timerStop_;         ///< Flag indicating timer thread shutdown
+    std::atomic<size_t>                                                 parkedWorkers_;     ///< Number of workers waiting on their queue's condition variable
+    int                                                                 epollFd_;           ///< epoll instance of the reactor (-1 until a descriptor is watched)
+    int                                                                 wakeFd_;            ///< eventfd waking the polling worker (-1 until a descriptor is watched)
+    std::atomic<bool>                                                   polling_;           ///< True while a worker blocks in epoll_wait
+    bool                                                                wakePending_;       ///< True while the eventfd is signalled but not yet drained
+    bool                                                                pollFailed_;        ///< True once epoll_wait failed; workers park instead of polling
+    std::unordered_map<int, std::shared_ptr<FileWatch>>                 watches_;           ///< Watched file descriptors
+    std::atomic<std::pmr::memory_resource*>                             memoryResource_;    ///< Pool-wide resource for task nodes and shared states
+    std::mutex                                                          errorMutex_;        ///< Mutex protecting the error handler
+    std::shared_ptr<const ErrorHandler>                                 errorHandler_;      ///< Sink for unhandled exceptions (nullptr if unset)
+    std::atomic<uint64_t>                                               exceptionCount_;    ///< Number of exceptions passed to the sink
+    std::array<DedupShard, DedupShardCount>                             dedupShards_;       ///< In-flight table of EnqueueDedup, sharded by key
+    std::atomic<uint64_t>                                               dedupHits_;         ///< Number of EnqueueDedup calls that joined an in-flight task
+    std::atomic<bool>                                                   perfCounters_;      ///< True while tasks are measured with performance counters
+    std::atomic<bool>                                                   hardwareCounters_;  ///< True once a worker opened hardware counters
+    std::vector<std::unique_ptr<PerfCounterTable>>                      perfTables_;        ///< Performance counters per worker, indexed like queues_
+    std::atomic<bool>                                                   tagCosts_;          ///< True while task costs are attributed to their tags
+    std::vector<std::unique_ptr<TagCostTable>>                          tagCostTables_;     ///< Tag costs per worker, indexed like queues_
+    std::vector<std::unique_ptr<WorkerSlot>>                            workerSlots_;       ///< Current task and accounting of every worker, indexed like workers_
+    std::atomic<bool>                                                   workerTime_;        ///< True while workers account their running and parked time
+    std::atomic<bool>                                                   watchdogEnabled_;   ///< True while workers publish their current task
+    std::mutex                                                          watchdogMutex_;     ///< Mutex protecting the watchdog settings and replacements
+    std::chrono::nanoseconds                                            watchdogThreshold_; ///< Running time after which a task is reported (zero if disabled)
+    WatchdogHandler                                                     watchdogHandler_;   ///< Receiver of watchdog reports
+    bool                                                                watchdogElastic_;   ///< True if stuck workers get a replacement thread
+    bool                                                                watchdogArmed_;     ///< True while a watchdog check is scheduled
+    std::list<Replacement>                                              replacements_;      ///< Replacement threads that have not been joined yet
+    std::atomic<uint64_t>                                               stuckTasks_;        ///< Number of tasks reported by the watchdog
+    std::atomic<size_t>                                                 replacementCount_;  ///< Number of replacement threads still in their work loop
+    std::mutex                                                          traceMutex_;        ///< Mutex serializing the start and stop of trace recordings
+    std::unique_ptr<TraceWriter>                                        traceWriter_;       ///< Writer of trace recordings (created by the first one)
+    std::atomic<bool>                                                   tracing_;           ///< True while submitted tasks are recorded
+    std::atomic<uint64_t>                                               nextTraceId_;       ///< Trace id of the next recorded task
+#if defined(__linux__)
+    mutable std::mutex                                                  sharedStatsMutex_;    ///< Mutex protecting the shared statistics segment
+    std::unique_ptr<SharedStatsSegment>                                 sharedStats_;         ///< Segment the statistics are published to (nullptr if disabled)
+    std::chrono::nanoseconds                                            sharedStatsInterval_; ///< Publishing interval
+    bool                                                                sharedStatsArmed_;    ///< True while a publication is scheduled
+    std::atomic<bool>                                                   sharedStatsEnabled_;  ///< True while workers count their sojourn times
+#endif
+
+    ///
+    /// \brief Number of workers and pinned CPUs of a domain, used to construct the pool
+    ///
+    struct DomainLayout
+    {
+        size_t                workers; ///< Number of workers
+        std::vector<unsigned> cpus;    ///< CPUs to pin the workers to (empty for no pinning)
+    };
+
+    ///
+    /// \brief Constructs the pool's queues, domains and workers from a layout
+    ///
+    /// \param layout Domains to create, in order
+    /// \param maxQueueSize Maximum size of the task queue
+    /// \param memoryResource Resource for the task queue and task nodes
+    ///
+    ThreadPool(const std::vector<DomainLayout>& layout, const size_t maxQueueSize, std::pmr::memory_resource* memoryResource);
+
+    ///
+    /// \brief Signals all worker threads to stop processing
+    ///
+    /// This method sets the stop flag to true while holding the queue mutex,
+    /// which will cause worker threads to exit their processing loop once
+    /// they check the condition variable. It is called by the destructor.
+    ///
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    void SignalThreadsToStop();
+
+    ///
+    /// \brief Work loop of a worker or replacement thread
+    ///
+    /// \param worker Index of the worker queue the thread serves
+    /// \param slot Slot of the thread
+    ///
+    void RunWorker(const size_t worker, WorkerSlot& slot);
+
+    ///
+    /// \brief Retrieves the next task for a worker
+    ///
+    /// This method handles the synchronization for worker threads waiting for
+    /// new tasks. It either returns the next task or an empty function if the
+    /// worker should exit (when the pool is stopping and the queues are empty,
+    /// or when a replacement thread is no longer needed).
+    ///
+    /// \param worker Index of the calling worker
+    /// \param slot Slot of the calling thread
+    /// \return QueuedTask Queue entry of the task to be executed, with an empty task if the worker should exit
+    /// \note Thread safety: Acquires and releases the queueMutex_ only to park
+    /// \note Blocks until a task is available or the pool is stopping
+    ///
+    QueuedTask GetNextTask(const size_t worker, WorkerSlot& slot);
+
+    ///
+    /// \brief Checks whether a replacement thread may exit
+    ///
+    /// \param slot Slot of the calling thread
+    /// \return bool True if the thread is a replacement and the worker it stands in for has finished its stuck task
+    ///
+    static bool IsReplacementRetired(const WorkerSlot& slot);
+
+    ///
+    /// \brief Reports stuck tasks, starts and reaps replacement threads
+    ///
+    /// Runs on the timer thread and reschedules itself while the watchdog is
+    /// enabled or replacement threads are alive.
+    ///
+    /// \note Thread safety: Acquires and releases the watchdogMutex_, and the queueMutex_ to wake retiring replacements
+    ///
+    void CheckWatchdog();
+
+#if defined(__linux__)
+    ///
+    /// \brief Copies the counters into the shared statistics segment
+    ///
+    /// Runs on the timer thread and reschedules itself while publishing is enabled.
+    ///
+    /// \note Thread safety: Acquires and releases the sharedStatsMutex_
+    ///
+    void PublishSharedStats();
+#endif
+
+    ///
+    /// \brief Runs a dequeued task, measuring it if performance counters are enabled
+    ///
+    /// \param worker Index of the calling worker
+    /// \param measured False for replacement threads, which share the worker's index but must not write its table
+    /// \param queued Queue entry of the task
+    ///
+    void RunTask(const size_t worker, const bool measured, QueuedTask& queued);
+
+    ///
+    /// \brief Assigns trace ids to a task being submitted
+    ///
+    /// \return TraceIds Ids of the task, or zero ids if no recording is running
+    ///
+    TraceIds NextTraceIds();
+
+    ///
+    /// \brief Adds the counter deltas of one task to the worker's table
+    ///
+    /// \param worker Index of the calling worker, which must own the table
+    /// \param tag Tag of the task
+    /// \param deltas Task count (one) followed by the counter differences
+    ///
+    void AddPerfCounts(const size_t worker, const char* tag, const std::array<uint64_t, 5>& deltas);
+
+    ///
+    /// \brief Adds the run time and queue wait of one task to the worker's tag cost table
+    ///
+    /// \param worker Index of the calling worker, which must own the table
+    /// \param tag Tag of the task
+    /// \param runTime Run time of the task in nanoseconds
+    /// \param queueWait Time from submission to start in nanoseconds
+    ///
+    void AddTagCost(const size_t worker, const char* tag, const int64_t runTime, const int64_t queueWait);
+
+    ///
+    /// \brief Returns whether the workers account their running and parked time
+    ///
+    /// \return bool True while SetWorkerTimeAccounting or the shared statistics are enabled
+    ///
+    bool IsWorkerTimeAccounted() const;
+
+    ///
+    /// \brief Returns the number of queued tasks the worker may take
+    ///
+    /// \param worker Index of the worker
+    /// \return size_t Tasks without hard affinity plus the tasks pinned to the worker
+    ///
+    size_t TakeableTasks(const size_t worker) const;
+
+    ///
+    /// \brief Takes a task from the worker's own queue, or steals one from another worker
+    ///
+    /// Victims in the worker's own domain are tried before remote ones. Pinned
+    /// tasks are only taken from the worker's own queue.
+    ///
+    /// \param worker Index of the calling worker
+    /// \param queued Receives the task
+    /// \return bool True if a task was taken, false if all queues were empty
+    /// \note Thread safety: Acquires and releases worker queue mutexes
+    ///
+    bool TakeTask(const size_t worker, QueuedTask& queued);
+
+    ///
+    /// \brief Pops the oldest task of a worker queue and moves it to the active count
+    ///
+    /// \param queue Queue to pop from
+    /// \param owner True if the caller owns the queue and may take pinned tasks
+    /// \param queued Receives the task
+    /// \return bool True if a task was popped, false if the queue had no task for the caller
+    /// \note Thread safety: Acquires and releases the queue's mutex
+    ///
+    bool PopTask(WorkerQueue& queue, const bool owner, QueuedTask& queued);
+
+    ///
+    /// \brief Chooses the worker queue for a new task
+    ///
+    /// A valid locality hint restricts the choice to the queues of that domain.
+    /// A task with affinity goes to the queue its key hashes to. A worker
+    /// submitting work keeps it in its own queue if that is allowed. Otherwise
+    /// the queue of a parked worker, found from a random start, is preferred,
+    /// and then the power of two choices applies: sample two queues at random
+    /// and take the shorter one.
+    ///
+    /// \param task Task to place
+    /// \return size_t Index of the chosen queue
+    /// \note Thread safety: Lock-free; queue sizes may be slightly stale
+    ///
+    size_t SelectQueue(const QueuedTask& task) const;
+
+    ///
+    /// \brief Notifies that a task has been completed
+    ///
+    /// This method decrements the active task counter and notifies waiting threads
+    /// if all tasks have completed. It is called by worker threads after executing
+    /// a task.
+    ///
+    /// \note Thread safety: Acquires and releases the queueMutex_
+    ///
+    void NotifyTaskCompletion();
+
+    ///
+    /// \brief Updates the admission state from the sojourn time of a dequeued task
+    ///
+    /// Implements the CoDel control law: the pool becomes overloaded once the
+    /// sojourn time has been above the target for a whole interval, and recovers
+    /// immediately when a task is dequeued below the target or the queues are empty.
+    /// The state is only written when it changes, so that workers dequeueing in
+    /// steady state share its cache line instead of bouncing it.
+    ///
+    /// \param sojournTime Time the dequeued task spent in the queue
+    /// \param now Time of the dequeue
+    /// \note Thread safety: Lock-free; concurrent updates may race, which only
+    ///       shifts the interval by the sojourn times of a few tasks
+    ///
+    void UpdateAdmissionState(const std::chrono::nanoseconds sojournTime, const std::chrono::steady_clock::time_point now);
+
+    ///
+    /// \brief Checks whether new tasks should be held back
+    ///
+    /// The check reads atomic counters and is not atomic with the following push,
+    /// so concurrent producers may overshoot the limits by a few tasks.
+    ///
+    /// \param footprint Bytes the task about to be enqueued would add to the queue
+    /// \return bool True if the queue is full, the memory budget would be exceeded or admission control reports overload
+    /// \note Thread safety: Lock-free
+    ///
+    bool IsQueueSaturated(const size_t footprint) const;
+
+    ///
+    /// \brief Checks whether a task for the given lane should be held back
+    ///
+    /// \param lane Lane id of the task (zero for the task queue)
+    /// \param footprint Bytes the task about to be enqueued would add to the queue
+    /// \return bool True if the task queue or the lane is saturated
+    /// \note Thread safety: Must be called with queueMutex_ locked unless lane is zero; the lane must have been checked
+    ///
+    bool IsQueueSaturated(const size_t lane, const size_t footprint) const;
+
+    ///
+    /// \brief Checks that a lane id passed in TaskOptions::lane was returned by CreateRateLimitedLane
+    ///
+    /// \param lane Lane id of the task (non-zero)
+    /// \throws std::invalid_argument If the lane does not exist
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    void CheckLane(const size_t lane) const;
+
+    ///
+    /// \brief Blocks a producer until the task queue or lane has space, for at most 100ms
+    ///
+    /// \param lock Lock on the queueMutex_, locked by this method if it is not yet
+    /// \param lane Lane id of the task (zero for the task queue)
+    /// \param footprint Bytes the task about to be enqueued would add to the queue
+    ///
+    void WaitForQueueSpace(std::unique_lock<std::mutex>& lock, const size_t lane, const size_t footprint);
+
+    ///
+    /// \brief Adds a task to a worker queue and wakes an idle worker
+    ///
+    /// \param task Task to add
+    /// \note Thread safety: Must be called without queueMutex_ locked; acquires it only if a worker has to be woken
+    ///
+    void PushTask(QueuedTask&& task);
+
+    ///
+    /// \brief Adds a task to the worker queue chosen by SelectQueue without waking a worker
+    ///
+    /// \param task Task to add
+    /// \return size_t Index of the chosen queue
+    /// \note Thread safety: Acquires and releases the chosen queue's mutex
+    ///
+    size_t AddToWorkerQueue(QueuedTask&& task);
+
+    ///
+    /// \brief Adds a task to its rate-limited lane and releases what the token bucket allows
+    ///
+    /// \param task Task to add
+    /// \param lane Lane id of the task
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    void HoldTask(QueuedTask&& task, const size_t lane);
+
+    ///
+    /// \brief Moves as many tasks from a lane into the task queue as its tokens allow
+    ///
+    /// Refills the lane's token bucket and releases held tasks while tokens are
+    /// available. If tasks remain, a timer is armed for the time the next token
+    /// becomes available.
+    ///
+    /// \param lane Lane id
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    void ReleaseLaneTasks(const size_t lane);
+
+    ///
+    /// \brief Schedules a callback on the pool's timer thread
+    ///
+    /// The timer thread is started on first use. Callbacks must be short since
+    /// they delay all later timers. Once the destructor has stopped the timer
+    /// thread, the callback is dropped.
+    ///
+    /// \param deadline Time at which the callback becomes due
+    /// \param callback Callback to run
+    /// \note Thread safety: Acquires and releases the timerMutex_
+    ///
+    void ScheduleTimer(const std::chrono::steady_clock::time_point deadline, std::function<void()> callback);
+
+    ///
+    /// \brief Wakes a worker for a newly queued task
+    ///
+    /// Notifies the owner of the queue if it is parked. Otherwise, unless the task
+    /// is pinned, a parked worker of the same domain or else of another domain is
+    /// notified to steal it. If no suitable worker is parked, the worker blocked
+    /// in epoll_wait is woken.
+    ///
+    /// \param queue Index of the queue the task was added to
+    /// \param pinned True if only the queue's owner may run the task
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    void NotifyTaskAvailable(const size_t queue, const bool pinned);
+
+    ///
+    /// \brief Notifies one parked worker with a queue in the given range
+    ///
+    /// Clears the worker's idle bit, so that the next notification and the
+    /// next SelectQueue pick a different worker.
+    ///
+    /// \param first Index of the first queue of the range
+    /// \param count Number of queues in the range
+    /// \return bool True if a worker was notified, false if none in the range is parked
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    bool NotifyParkedWorker(const size_t first, const size_t count);
+
+    ///
+    /// \brief Finds a parked worker with a queue in the given range
+    ///
+    /// The scan starts at a random queue of the range and wraps around, so that
+    /// concurrent producers and notifications spread over all parked workers
+    /// instead of piling onto the lowest one.
+    ///
+    /// \param first Index of the first queue of the range
+    /// \param count Number of queues in the range (at least one)
+    /// \return size_t Index of a parked worker, or queues_.size() if none in the range is parked
+    /// \note Thread safety: Lock-free; the idle bits may be slightly stale
+    ///
+    size_t FindIdleWorker(const size_t first, const size_t count) const;
+
+#if defined(__linux__)
+    ///
+    /// \brief Blocks the calling worker in epoll_wait until a descriptor is ready or it is woken
+    ///
+    /// Releases the queueMutex_ while waiting. Ready descriptors are returned as
+    /// a task that runs their callbacks on the calling worker and re-arms them.
+    /// If epoll_wait fails with anything but EINTR, the error is reported to the
+    /// error handler and the reactor is given up, so that idle workers park
+    /// instead of spinning on the failing call.
+    ///
+    /// \param lock Lock holding the queueMutex_
+    /// \param worker Index of the calling worker
+    /// \return Task Task dispatching the ready callbacks, or an empty task if none became ready
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    Task PollFileDescriptors(std::unique_lock<std::mutex>& lock, const size_t worker);
+#endif
+
+    ///
+    /// \brief Wakes the worker blocked in epoll_wait, if any
+    ///
+    /// \note Thread safety: Must be called with queueMutex_ locked
+    ///
+    void WakePoller();
+
+    ///
+    /// \brief Main loop of the timer thread
+    ///
+    /// Runs due callbacks outside of the timerMutex_ until the pool is destroyed.
+    ///
+    void RunTimers();
+
+    ///
+    /// \brief Resolves the number of bytes a task is charged against the memory budget
+    ///
+    /// \tparam F Type of the callable object
+    /// \tparam Args Types of arguments to pass to the callable object
+    /// \param options Submission options carrying an optional explicit footprint
+    /// \return size_t Explicit footprint if given, otherwise the size of the decayed callable and arguments
+    ///
+    template<class F, class... Args> static size_t TaskFootprint(const TaskOptions& options);
+
+    ///
+    /// \brief Invokes a stored invocation and stores its result in a promise
+    ///
+    /// \param promise Promise receiving the result
+    /// \param invocation Invocation created by ThreadPoolDetail::MakeInvocation
+    ///
+    template<class R, class Invocation> static void FulfilPromise(std::promise<R>& promise, Invocation& invocation);
+
+    ///
+    /// \brief Counts an unhandled exception and passes it to the error handler
+    ///
+    /// \param exception Exception thrown by a fire-and-forget task or callback
+    /// \param tag Tag of the task (may be nullptr)
+    /// \note Thread safety: Acquires and releases the errorMutex_
+    ///
+    void ReportException(std::exception_ptr exception, const char* tag) noexcept;
+
+    ///
+    /// \brief Returns the in-flight table shard of a key
+    ///
+    /// \param key Key passed to EnqueueDedup
+    /// \return DedupShard& Shard holding the key
+    ///
+    DedupShard& DedupShardFor(const uint64_t key);
+
+    ///
+    /// \brief Removes a finished task from the in-flight table
+    ///
+    /// \param key Key passed to EnqueueDedup
+    /// \note Thread safety: Acquires and releases the shard's mutex
+    ///
+    void ReleaseDedupKey(const uint64_t key);
+
+    ///
+    /// \brief Resolves the memory resource a submission allocates from
+    ///
+    /// \param options Submission options carrying an optional resource
+    /// \return std::pmr::memory_resource* The options' resource if set, otherwise the pool-wide resource
+    ///
+    std::pmr::memory_resource* ResolveMemoryResource(const TaskOptions& options) const;
+
+    ///
+    /// \brief Queues a type-erased task in its lane or a worker queue, waiting briefly if the queue is saturated
+    ///
+    /// Shared by Enqueue and EnqueueDedup once they have wrapped the callable.
+    /// If it throws, the task has not been queued.
+    ///
+    /// \param options Submission options of the task
+    /// \param footprint Bytes the task is charged against the memory budget
+    /// \param task Task to queue
+    /// \throws std::runtime_error If the thread pool has been stopped
+    /// \throws std::invalid_argument If TaskOptions::lane is not a lane of this pool
+    /// \note Thread safety: Acquires and releases the queueMutex_ for lanes and while waiting
+    ///
+    void SubmitTask(const TaskOptions& options, const size_t footprint, Task&& task);
+};
+
+template<class R, class Invocation> void ThreadPool::FulfilPromise(std::promise<R>& promise, Invocation& invocation)
+{
+    if constexpr (std::is_void_v<R>)
+    {
+        invocation();
+        promise.set_value();
+    }
+    else
+    {
+        promise.set_value(invocation());
+    }
+}
+
+///
+/// \brief Template implementation of Enqueue method - must be in header
+///
+template<class F, class... Args>
+    requires(false == std::is_same_v<std::remove_cvref_t<F>, ThreadPool::TaskOptions>)
+auto ThreadPool::Enqueue(F&& f, Args&&... args) -> std::future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>
+{
+    return Enqueue(TaskOptions {}, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+///
+/// \brief Template implementation of Enqueue with options - must be in header
+///
+/// \note This implementation stores a promise next to the stored invocation in a
+///       single task node. The node and the promise's shared state are both
+///       allocated from the resolved memory resource. Tasks marked nothrow
+///       are invoked without a try/catch and never store an exception_ptr.
+///
+template<class F, class... Args>
+auto ThreadPool::Enqueue(const TaskOptions& options, F&& f, Args&&... args) -> std::future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>
+{
+    using return_type = typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type;
+
+    // The future's shared state comes from the same memory resource as the task node
+    std::pmr::memory_resource* const resource = ResolveMemoryResource(options);
+    std::promise<return_type>        promise(std::allocator_arg, std::pmr::polymorphic_allocator<char>(resource));
+    std::future<return_type>         futureResult = promise.get_future();
+
+    // Create a task that invokes the function with its args and fulfils the promise
+    auto invocation = ThreadPoolDetail::MakeInvocation(std::forward<F>(f), std::forward<Args>(args)...);
+    Task task;
+    if (true == options.nothrow)
+    {
+        // No handler frame and no exception_ptr - an exception terminates the process
+        task = Task(resource, [promise = std::move(promise), function = std::move(invocation)]() mutable noexcept { FulfilPromise(promise, function); });
+    }
+    else
+    {
+        task = Task(resource, [promise = std::move(promise), function = std::move(invocation)]() mutable {
+            try
+            {
+                FulfilPromise(promise, function);
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+        });
+    }
+
+    SubmitTask(options, TaskFootprint<F, Args...>(options), std::move(task));
+    return futureResult;
+}
+
+///
+/// \brief Non-blocking enqueue implementation - template must be in header
+///
+/// \note This implementation differs from Enqueue by never waiting when the
+///       queue is full, instead returning false immediately. Useful for
+///       implementing backpressure mechanisms.
+///
+template<class F, class... Args>
+    requires(false == std::is_same_v<std::remove_cvref_t<F>, ThreadPool::TaskOptions>)
+bool ThreadPool::TryEnqueue(F&& f, Args&&... args)
+{
+    return TryEnqueue(TaskOptions {}, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+///
+/// \brief Non-blocking enqueue implementation with options - template must be in header
+///
+template<class F, class... Args> bool ThreadPool::TryEnqueue(const TaskOptions& options, F&& f, Args&&... args)
+{
+    // Like Enqueue, only lanes need the queue mutex
+    const size_t                 footprint = TaskFootprint<F, Args...>(options);
+    std::unique_lock<std::mutex> lock(queueMutex_, std::defer_lock);
+    if (0 != options.lane)
+    {
+        lock.lock();
+        CheckLane(options.lane);
+    }
+
+    // Don't allow enqueueing after stopping the pool
+    if (true == stop_)
+    {
+        return false;
+    }
+
+    // If queue is full, over budget or the sojourn time exceeds the admission target, return false immediately
+    if (true == IsQueueSaturated(options.lane, footprint))
+    {
+        rejectedTasks_++;
+        return false;
+    }
+
+    // Create a task that invokes the function with its args; without a future there is
+    // no receiver for exceptions, so they go to the pool's error sink
+    std::pmr::memory_resource* const resource   = ResolveMemoryResource(options);
+    auto                             invocation = ThreadPoolDetail::MakeInvocation(std::forward<F>(f), std::forward<Args>(args)...);
+    Task                             task;
+    if (true == options.nothrow)
+    {
+        task = Task(resource, [function = std::move(invocation)]() mutable noexcept { function(); });
+    }
+    else
+    {
+        task = Task(resource, [this, tag = options.tag, function = std::move(invocation)]() mutable {
+            try
+            {
+                function();
+            }
+            catch (...)
+            {
+                ReportException(std::current_exception(), tag);
+            }
+        });
+    }
+
+    // Add the task to its lane, or to a worker queue and notify one worker thread that a task is available
+    QueuedTask queued {std::move(task), std::chrono::steady_clock::now(), footprint, options.locality, options.affinity, options.affinityKey, options.tag, NextTraceIds()};
+    if (0 != options.lane)
+    {
+        HoldTask(std::move(queued), options.lane);
+    }
+    else
+    {
+        PushTask(std::move(queued));
+    }
+    return true;
+}
+
+template<class F, class... Args>
+auto ThreadPool::EnqueueDedup(const uint64_t key, F&& f, Args&&... args) -> std::shared_future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>
+{
+    return EnqueueDedup(TaskOptions {}, key, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+///
+/// \brief Deduplicating enqueue implementation - template must be in header
+///
+/// \note The key is registered with a promise-backed future before the task is
+///       enqueued, so the shard is not locked while Enqueue waits for queue space
+///       and the task cannot release its key before it has been registered.
+///
+template<class F, class... Args>
+auto ThreadPool::EnqueueDedup(const TaskOptions& options, const uint64_t key, F&& f, Args&&... args)
+    -> std::shared_future<typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type>
+{
+    using return_type = typename std::invoke_result<std::decay_t<F>, std::decay_t<Args>...>::type;
+
+    // The flight and the promise's shared state come from the same memory resource as the task node
+    std::pmr::memory_resource* const            resource = ResolveMemoryResource(options);
+    const std::pmr::polymorphic_allocator<char> allocator(resource);
+    std::shared_ptr<DedupFlight<return_type>>   flight;
+    bool                                        tracked = false;
+
+    DedupShard& shard = DedupShardFor(key);
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        // Join the in-flight task if it computes the same type of result
+        auto entry = shard.entries.find(key);
+        if (shard.entries.end() != entry && typeid(return_type) == *entry->second.type)
+        {
+            dedupHits_.fetch_add(1, std::memory_order_relaxed);
+            return std::static_pointer_cast<DedupFlight<return_type>>(entry->second.flight)->future;
+        }
+
+        // A different result type under the same key runs untracked
+        flight = std::allocate_shared<DedupFlight<return_type>>(allocator, allocator);
+        if (shard.entries.end() == entry)
+        {
+            shard.entries.emplace(key, DedupEntry {&typeid(return_type), flight});
+            tracked = true;
+        }
+    }
+
+    try
+    {
+        // Release the key when the computation returns or throws, before the result is published
+        Task task(resource, [this, key, tracked, flight, function = ThreadPoolDetail::MakeInvocation(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+            const auto release = [this, key, tracked] {
+                if (true == tracked)
+                {
+                    ReleaseDedupKey(key);
+                }
+            };
+
+            try
+            {
+                if constexpr (std::is_void_v<return_type>)
+                {
+                    function();
+                    release();
+                    flight->promise.set_value();
+                }
+                else
+                {
+                    return_type result = function();
+                    release();
+                    flight->promise.set_value(std::forward<return_type>(result));
+                }
+            }
+            catch (...)
+            {
+                release();
+                flight->promise.set_exception(std::current_exception());
+            }
+        });
+
+        SubmitTask(options, TaskFootprint<F, Args...>(options), std::move(task));
+    }
+    catch (...)
+    {
+        // Callers that joined in the meantime see the same failure; a later
+        // submission of the key may already have replaced the entry
+        flight->promise.set_exception(std::current_exception());
+        if (true == tracked)
+        {
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            auto                         entry = shard.entries.find(key);
+            if (shard.entries.end() != entry && flight == entry->second.flight)
+            {
+                shard.entries.erase(entry);
+            }
+        }
+        throw;
+    }
+    return flight->future;
+}
+
+template<class F, class... Args> size_t ThreadPool::TaskFootprint(const TaskOptions& options)
+{
+    if (0 != options.footprint)
+    {
+        return options.footprint;
+    }
+
+    // Without an explicit footprint, charge the state the task captures by value
+    return sizeof(std::decay_t<F>) + (static_cast<size_t>(0) + ... + sizeof(std::decay_t<Args>));
+}
+
+template<class Callable> ThreadPool::Task::Task(std::pmr::memory_resource* resource, Callable&& callable)
+{
+    using NodeType = CallableNode<std::decay_t<Callable>>;
+
+    void* memory = resource->allocate(sizeof(NodeType), alignof(NodeType));
+    try
+    {
+        node_ = ::new (memory) NodeType(resource, std::forward<Callable>(callable));
+    }
+    catch (...)
+    {
+        resource->deallocate(memory, sizeof(NodeType), alignof(NodeType));
+        throw;
+    }
+}
+
+template<class Callable>
+ThreadPool::Task::CallableNode<Callable>::CallableNode(std::pmr::memory_resource* nodeResource, Callable&& nodeCallable) :
+    resource(nodeResource), callable(std::move(nodeCallable))
+{
+}
+
+template<class Callable> void ThreadPool::Task::CallableNode<Callable>::Run()
+{
+    callable();
+}
+
+template<class Callable> void ThreadPool::Task::CallableNode<Callable>::Destroy() noexcept
+{
+    // Remember the resource before the node (and its resource member) is destroyed
+    std::pmr::memory_resource* const nodeResource = resource;
+    this->~CallableNode();
+    nodeResource->deallocate(this, sizeof(CallableNode), alignof(CallableNode));
 }
 
 #endif // __THREAD_POOL_H_INCL__
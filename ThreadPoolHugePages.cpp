@@ -0,0 +1,152 @@
+///
+/// \file ThreadPoolHugePages.cpp
+/// \brief Implementation of the HugePageMemoryResource class
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolHugePages.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <linux/mempolicy.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26) // log2(2 MiB) << MAP_HUGE_SHIFT
+#endif
+
+namespace
+{
+// Thin wrapper around the raw system call, so that no libnuma is required
+void PreferNode(void* address, const size_t bytes, const int numaNode)
+{
+    constexpr size_t BitsPerWord = 8 * sizeof(unsigned long);
+    unsigned long    nodeMask[16] {};
+    if (static_cast<size_t>(numaNode) >= BitsPerWord * std::size(nodeMask))
+    {
+        return;
+    }
+
+    nodeMask[numaNode / BitsPerWord] = 1UL << (numaNode % BitsPerWord);
+
+    // Placement is a hint only - without NUMA support the pages stay where the kernel puts them
+    syscall(SYS_mbind, address, bytes, MPOL_PREFERRED, nodeMask, BitsPerWord * std::size(nodeMask), 0);
+}
+} // namespace
+
+HugePageMemoryResource::HugePageMemoryResource(const int numaNode) :
+    numaNode_(numaNode), hugeTlbBytes_(0), transparentHugePageBytes_(0), normalPageBytes_(0)
+{
+}
+
+HugePageMemoryResource::Statistics HugePageMemoryResource::GetStatistics() const
+{
+    std::unique_lock<std::mutex> lock(mappingMutex_);
+    return Statistics {hugeTlbBytes_, transparentHugePageBytes_, normalPageBytes_};
+}
+
+void* HugePageMemoryResource::do_allocate(size_t bytes, size_t alignment)
+{
+    // Mappings are page aligned; stricter alignments beyond a huge page are not supported
+    if (alignment > HugePageSize)
+    {
+        throw std::bad_alloc();
+    }
+
+    const size_t mappingSize = (std::max<size_t>(bytes, 1) + HugePageSize - 1) / HugePageSize * HugePageSize;
+
+    Backing backing = Backing::NormalPages;
+    void*   mapping = MapPages(mappingSize, backing);
+    if (nullptr == mapping)
+    {
+        throw std::bad_alloc();
+    }
+
+    if (numaNode_ >= 0)
+    {
+        PreferNode(mapping, mappingSize, numaNode_);
+    }
+
+    std::unique_lock<std::mutex> lock(mappingMutex_);
+    mappings_.emplace(mapping, backing);
+    BackingCounter(backing) += mappingSize;
+    return mapping;
+}
+
+void HugePageMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t /*alignment*/)
+{
+    const size_t mappingSize = (std::max<size_t>(bytes, 1) + HugePageSize - 1) / HugePageSize * HugePageSize;
+
+    {
+        std::unique_lock<std::mutex> lock(mappingMutex_);
+        auto                         mapping = mappings_.find(pointer);
+        if (mappings_.end() == mapping)
+        {
+            return;
+        }
+
+        BackingCounter(mapping->second) -= mappingSize;
+        mappings_.erase(mapping);
+    }
+
+    munmap(pointer, mappingSize);
+}
+
+bool HugePageMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void* HugePageMemoryResource::MapPages(const size_t bytes, Backing& backing) const
+{
+    constexpr int Protection = PROT_READ | PROT_WRITE;
+    constexpr int Flags      = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    // 1. Explicit huge pages, only succeeds if the administrator reserved enough of them
+    void* mapping = mmap(nullptr, bytes, Protection, Flags | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+    if (MAP_FAILED != mapping)
+    {
+        backing = Backing::HugeTlb;
+        return mapping;
+    }
+
+    // 2. Transparent huge pages - the kernel only backs 2 MiB aligned ranges with
+    //    huge pages, so over-map by one huge page and trim both ends to alignment
+    mapping = mmap(nullptr, bytes + HugePageSize, Protection, Flags, -1, 0);
+    if (MAP_FAILED == mapping)
+    {
+        return nullptr;
+    }
+
+    const uintptr_t start   = reinterpret_cast<uintptr_t>(mapping);
+    const uintptr_t aligned = (start + HugePageSize - 1) & ~(uintptr_t {HugePageSize} - 1);
+    const size_t    leading = aligned - start;
+    if (0 < leading)
+    {
+        munmap(mapping, leading);
+    }
+    munmap(reinterpret_cast<void*>(aligned + bytes), HugePageSize - leading);
+    mapping = reinterpret_cast<void*>(aligned);
+
+    // 3. Without THP support (or with it disabled) the range keeps normal pages
+    backing = (0 == madvise(mapping, bytes, MADV_HUGEPAGE)) ? Backing::TransparentHugePages : Backing::NormalPages;
+    return mapping;
+}
+
+size_t& HugePageMemoryResource::BackingCounter(const Backing backing)
+{
+    switch (backing)
+    {
+        case Backing::HugeTlb:
+            return hugeTlbBytes_;
+        case Backing::TransparentHugePages:
+            return transparentHugePageBytes_;
+        default:
+            return normalPageBytes_;
+    }
+}
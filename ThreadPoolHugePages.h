@@ -0,0 +1,122 @@
+///
+/// \file ThreadPoolHugePages.h
+/// \brief Memory resource backed by 2 MiB pages for task storage and queues
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_HUGE_PAGES_H_INCL__
+#define __THREAD_POOL_HUGE_PAGES_H_INCL__
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <unordered_map>
+
+///
+/// \brief Memory resource that maps its allocations with 2 MiB pages
+///
+/// With millions of tasks in flight, task nodes and queue blocks spread over
+/// hundreds of megabytes and dequeueing suffers from dTLB misses. This resource
+/// maps every allocation, rounded up to a multiple of 2 MiB, with the largest
+/// pages available:
+///
+/// 1. Explicit huge pages (MAP_HUGETLB), if the system has reserved any
+/// 2. Transparent huge pages (2 MiB aligned mapping plus madvise(MADV_HUGEPAGE))
+/// 3. Normal pages, if neither is available
+///
+/// If a NUMA node is given, the pages are preferably placed on that node.
+///
+/// It is meant as the upstream of a TaskMemoryResource with 2 MiB slabs, which
+/// is then passed to the ThreadPool constructor so that both the task queue and
+/// the task nodes live on huge pages:
+///
+/// \code
+/// HugePageMemoryResource hugePages;
+/// TaskMemoryResource     taskMemory(&hugePages, HugePageMemoryResource::HugePageSize);
+/// ThreadPool             pool(8, 1'000'000, &taskMemory);
+/// \endcode
+///
+/// \note Requests the TaskMemoryResource passes through (above 16 KiB or
+///       aligned beyond 64 bytes) cost an mmap and an munmap of at least
+///       2 MiB each. Tasks that capture that much state should allocate it
+///       elsewhere or be submitted with their own TaskOptions::memoryResource.
+/// \note Only available on Linux (THREADPOOL_HAS_HUGE_PAGES is defined).
+/// \note Thread safety: All operations are thread-safe.
+///
+class HugePageMemoryResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t HugePageSize = 2 * 1024 * 1024; ///< Size of a huge page and granularity of all mappings
+
+    ///
+    /// \brief Bytes currently mapped per page type
+    ///
+    struct Statistics
+    {
+        size_t hugeTlbBytes;             ///< Bytes mapped with explicit huge pages
+        size_t transparentHugePageBytes; ///< Bytes mapped with transparent huge pages requested
+        size_t normalPageBytes;          ///< Bytes mapped with normal pages
+    };
+
+    ///
+    /// \brief Creates a huge page resource
+    ///
+    /// \param numaNode NUMA node to place pages on (negative for the default policy)
+    ///
+    explicit HugePageMemoryResource(const int numaNode = -1);
+
+    // Delete copy constructor and assignment operator
+    HugePageMemoryResource(const HugePageMemoryResource&)            = delete;
+    HugePageMemoryResource& operator=(const HugePageMemoryResource&) = delete;
+
+    ///
+    /// \brief Returns the bytes currently mapped per page type
+    ///
+    /// \return Statistics Mapped bytes
+    /// \note Thread safety: Acquires and releases the mappingMutex_
+    ///
+    Statistics GetStatistics() const;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    ///
+    /// \brief Page type of a mapping
+    ///
+    enum class Backing
+    {
+        HugeTlb,
+        TransparentHugePages,
+        NormalPages
+    };
+
+    const int                          numaNode_;                 ///< Preferred NUMA node (negative for the default policy)
+    mutable std::mutex                 mappingMutex_;             ///< Mutex protecting the mapping registry and counters
+    std::unordered_map<void*, Backing> mappings_;                 ///< Page type of every live mapping
+    size_t                             hugeTlbBytes_;             ///< Bytes mapped with explicit huge pages
+    size_t                             transparentHugePageBytes_; ///< Bytes mapped with transparent huge pages requested
+    size_t                             normalPageBytes_;          ///< Bytes mapped with normal pages
+
+    ///
+    /// \brief Maps the given number of bytes with the largest pages available
+    ///
+    /// \param bytes Size of the mapping, a multiple of HugePageSize
+    /// \param backing Receives the page type of the mapping
+    /// \return void* Start of the mapping, or nullptr if nothing could be mapped
+    ///
+    void* MapPages(const size_t bytes, Backing& backing) const;
+
+    ///
+    /// \brief Counter of the bytes mapped with the given page type
+    ///
+    /// \note Thread safety: The caller must hold the mappingMutex_
+    ///
+    size_t& BackingCounter(const Backing backing);
+};
+
+#endif // __THREAD_POOL_HUGE_PAGES_H_INCL__
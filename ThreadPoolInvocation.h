@@ -0,0 +1,39 @@
+///
+/// \file ThreadPoolInvocation.h
+/// \brief Single-use invocation of a callable with stored arguments, shared by the pool classes
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_INVOCATION_H_INCL__
+#define __THREAD_POOL_INVOCATION_H_INCL__
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ThreadPoolDetail
+{
+///
+/// \brief Stores a callable and its decayed arguments for a single invocation
+///
+/// Replaces std::bind, which passes bound arguments as lvalues: the returned
+/// callable applies the stored arguments as rvalues, so it can consume
+/// move-only arguments. It must be invoked at most once.
+///
+/// \tparam F Type of the callable object
+/// \tparam Args Types of arguments to pass to the callable object
+/// \param f The callable object to store
+/// \param args Arguments to store
+/// \return auto Move-only callable invoking f with the stored arguments
+///
+template<class F, class... Args> auto MakeInvocation(F&& f, Args&&... args)
+{
+    return [function = std::forward<F>(f), arguments = std::tuple<std::decay_t<Args>...>(std::forward<Args>(args)...)]() mutable -> decltype(auto) {
+        return std::apply(std::move(function), std::move(arguments));
+    };
+}
+} // namespace ThreadPoolDetail
+
+#endif // __THREAD_POOL_INVOCATION_H_INCL__
@@ -0,0 +1,327 @@
+///
+/// \file ThreadPoolIoUring.cpp
+/// \brief Implementation of the IoUring class
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolIoUring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// Thin wrappers around the raw system calls, so that no liburing is required
+int SetupRing(const unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int EnterRing(const int ringFd, const unsigned toSubmit, const unsigned minComplete, const unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+///
+/// \brief Tag of completion tasks, passed to the pool's error handler
+///
+constexpr const char* CompletionTag = "io_uring";
+
+unsigned LoadAcquire(unsigned* value)
+{
+    return std::atomic_ref<unsigned>(*value).load(std::memory_order_acquire);
+}
+
+void StoreRelease(unsigned* value, const unsigned newValue)
+{
+    std::atomic_ref<unsigned>(*value).store(newValue, std::memory_order_release);
+}
+} // namespace
+
+IoUring::IoUring(ThreadPool& pool, const unsigned entries) :
+    pool_(pool), ringFd_(-1), ringMemory_(MAP_FAILED), ringSize_(0), sqes_(nullptr), sqesSize_(0), inFlight_(0), stopping_(false), failure_(0)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ringFd_ = SetupRing(entries, &params);
+    if (ringFd_ < 0)
+    {
+        throw std::system_error(errno, std::system_category(), "io_uring_setup");
+    }
+
+    // Map the submission and completion rings. Kernels with IORING_FEAT_SINGLE_MMAP
+    // (5.4+) expose both rings in one mapping; the read and write opcodes used
+    // here require 5.6, so a single mapping sized for the larger ring suffices
+    const size_t sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ringSize_               = std::max(sqRingSize, cqRingSize);
+    ringMemory_             = mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ringMemory_ || 0 == (params.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        const int error = (MAP_FAILED == ringMemory_) ? errno : ENOSYS;
+        if (MAP_FAILED != ringMemory_)
+        {
+            munmap(ringMemory_, ringSize_);
+        }
+        close(ringFd_);
+        throw std::system_error(error, std::system_category(), "io_uring ring mapping");
+    }
+
+    sqesSize_     = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqesMap = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if (MAP_FAILED == sqesMap)
+    {
+        const int error = errno;
+        munmap(ringMemory_, ringSize_);
+        close(ringFd_);
+        throw std::system_error(error, std::system_category(), "io_uring SQE mapping");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqesMap);
+
+    // Resolve the ring fields from the offsets reported by the kernel
+    char* ring = static_cast<char*>(ringMemory_);
+    sqHead_    = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    sqTail_    = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    sqMask_    = reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    sqArray_   = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    cqHead_    = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    cqTail_    = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    cqMask_    = reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    cqes_      = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    cqEntries_ = params.cq_entries;
+
+    // The poller blocks in the kernel until completions arrive, so idle
+    // rings cost no CPU time
+    poller_ = std::thread([this] { ReapCompletions(); });
+}
+
+IoUring::~IoUring()
+{
+    // Submit a no-op without operation state - its completion wakes the poller,
+    // which exits once every operation submitted before it has been reaped.
+    // A failed ring has no poller left to wake
+    bool failed = false;
+    {
+        std::unique_lock<std::mutex> lock(submitMutex_);
+        stopping_ = true;
+        failed    = (0 != failure_);
+    }
+    if (false == failed)
+    {
+        try
+        {
+            Submit(IORING_OP_NOP, -1, 0, 0, 0, nullptr);
+        }
+        catch (const std::system_error&)
+        {
+            // The poller failed in the meantime and has already exited
+        }
+    }
+
+    poller_.join();
+
+    munmap(sqes_, sqesSize_);
+    munmap(ringMemory_, ringSize_);
+    close(ringFd_);
+}
+
+void IoUring::Read(const int fd, void* buffer, const size_t size, const uint64_t offset, Completion completion)
+{
+    auto operation = std::make_unique<Operation>(Operation {std::move(completion)});
+    Submit(IORING_OP_READ, fd, reinterpret_cast<uint64_t>(buffer), size, offset, operation.get());
+    operation.release(); // Owned by the ring until the completion is reaped
+}
+
+std::future<ssize_t> IoUring::Read(const int fd, void* buffer, const size_t size, const uint64_t offset)
+{
+    auto                 promise = std::make_shared<std::promise<ssize_t>>();
+    std::future<ssize_t> result  = promise->get_future();
+    Read(fd, buffer, size, offset, [promise](const ssize_t bytes) { promise->set_value(bytes); });
+    return result;
+}
+
+void IoUring::Write(const int fd, const void* buffer, const size_t size, const uint64_t offset, Completion completion)
+{
+    auto operation = std::make_unique<Operation>(Operation {std::move(completion)});
+    Submit(IORING_OP_WRITE, fd, reinterpret_cast<uint64_t>(buffer), size, offset, operation.get());
+    operation.release(); // Owned by the ring until the completion is reaped
+}
+
+std::future<ssize_t> IoUring::Write(const int fd, const void* buffer, const size_t size, const uint64_t offset)
+{
+    auto                 promise = std::make_shared<std::promise<ssize_t>>();
+    std::future<ssize_t> result  = promise->get_future();
+    Write(fd, buffer, size, offset, [promise](const ssize_t bytes) { promise->set_value(bytes); });
+    return result;
+}
+
+bool IoUring::IsSupported()
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    const int ringFd = SetupRing(1, &params);
+    if (ringFd < 0)
+    {
+        return false;
+    }
+
+    close(ringFd);
+    return 0 != (params.features & IORING_FEAT_SINGLE_MMAP);
+}
+
+void IoUring::Submit(const uint8_t opcode, const int fd, const uint64_t address, const size_t length, const uint64_t offset, Operation* operation)
+{
+    if (length > UINT32_MAX)
+    {
+        throw std::invalid_argument("io_uring request exceeds 4 GiB");
+    }
+
+    std::unique_lock<std::mutex> lock(submitMutex_);
+
+    // Never have more operations in flight than the completion queue can hold
+    capacity_.wait(lock, [this] { return inFlight_ < cqEntries_ || 0 != failure_; });
+    if (0 != failure_)
+    {
+        throw std::system_error(failure_, std::system_category(), "io_uring completion poller");
+    }
+
+    // Every submission is handed to the kernel immediately, so the submission
+    // queue is always drained and the slot at the tail is free
+    const unsigned tail  = *sqTail_;
+    const unsigned index = tail & *sqMask_;
+
+    io_uring_sqe& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode    = opcode;
+    sqe.fd        = fd;
+    sqe.addr      = address;
+    sqe.len       = static_cast<uint32_t>(length);
+    sqe.off       = offset;
+    sqe.user_data = reinterpret_cast<uint64_t>(operation);
+
+    sqArray_[index] = index;
+    StoreRelease(sqTail_, tail + 1);
+
+    int submitted = 0;
+    do
+    {
+        submitted = EnterRing(ringFd_, 1, 0, 0);
+    }
+    while (submitted < 0 && EINTR == errno);
+
+    if (submitted < 0)
+    {
+        // Withdraw the entry so that it is not picked up by a later submission
+        StoreRelease(sqTail_, tail);
+        throw std::system_error(errno, std::system_category(), "io_uring_enter");
+    }
+
+    inFlight_++;
+    if (nullptr != operation)
+    {
+        pending_.insert(operation);
+    }
+}
+
+void IoUring::ReapCompletions()
+{
+    std::vector<std::pair<Operation*, ssize_t>> completed;
+    for (;;)
+    {
+        // Sleep in the kernel until at least one completion is available
+        if (EnterRing(ringFd_, 0, 1, IORING_ENTER_GETEVENTS) < 0 && EINTR != errno)
+        {
+            // Without a working ring no completion will arrive any more: fail the
+            // pending operations and let blocked and later submitters throw
+            const int                      error = errno;
+            std::unordered_set<Operation*> pending;
+            {
+                std::unique_lock<std::mutex> lock(submitMutex_);
+                failure_  = error;
+                inFlight_ = 0;
+                pending.swap(pending_);
+                capacity_.notify_all();
+            }
+            for (Operation* operation : pending)
+            {
+                Dispatch(std::unique_ptr<Operation>(operation), -ECANCELED);
+            }
+            return;
+        }
+
+        // Only this thread advances the completion head
+        unsigned       head = *cqHead_;
+        const unsigned tail = LoadAcquire(cqTail_);
+        completed.clear();
+        while (head != tail)
+        {
+            const io_uring_cqe& cqe = cqes_[head & *cqMask_];
+            completed.emplace_back(reinterpret_cast<Operation*>(cqe.user_data), cqe.res);
+            head++;
+        }
+
+        // Hand the consumed entries back to the kernel
+        StoreRelease(cqHead_, head);
+
+        bool stopped = false;
+        {
+            std::unique_lock<std::mutex> lock(submitMutex_);
+            inFlight_ -= completed.size();
+            for (const std::pair<Operation*, ssize_t>& entry : completed)
+            {
+                pending_.erase(entry.first);
+            }
+            capacity_.notify_all();
+            stopped = (true == stopping_ && 0 == inFlight_);
+        }
+
+        // Resume the issuers outside of the lock; the shutdown no-op carries no operation
+        for (const std::pair<Operation*, ssize_t>& entry : completed)
+        {
+            if (nullptr != entry.first)
+            {
+                Dispatch(std::unique_ptr<Operation>(entry.first), entry.second);
+            }
+        }
+
+        if (true == stopped)
+        {
+            return;
+        }
+    }
+}
+
+void IoUring::Dispatch(std::unique_ptr<Operation> operation, const ssize_t result)
+{
+    // TryEnqueue leaves the completion untouched if it rejects the task
+    ThreadPool::TaskOptions options;
+    options.tag = CompletionTag;
+    if (true == pool_.TryEnqueue(options, std::move(operation->completion), result))
+    {
+        return;
+    }
+
+    // A saturated pool must not stall every other completion, so the poller runs this one itself
+    try
+    {
+        operation->completion(result);
+    }
+    catch (...)
+    {
+        pool_.ReportException(std::current_exception(), CompletionTag);
+    }
+}
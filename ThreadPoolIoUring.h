@@ -0,0 +1,210 @@
+///
+/// \file ThreadPoolIoUring.h
+/// \brief Asynchronous file I/O on io_uring with completions dispatched to a ThreadPool
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_IO_URING_H_INCL__
+#define __THREAD_POOL_IO_URING_H_INCL__
+
+#include "ThreadPool.h"
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_set>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+///
+/// \brief Asynchronous file reads and writes on an io_uring instance
+///
+/// The IoUring class submits reads and writes to a kernel io_uring instance
+/// instead of blocking a worker in pread/pwrite. A dedicated completion poller
+/// thread reaps completions and enqueues the issuing callback on the associated
+/// ThreadPool, so continuations always run on a pool worker. A few workers can
+/// then keep many requests in flight against fast storage.
+///
+/// Results follow the kernel convention: the number of bytes transferred, or
+/// a negated errno value on failure.
+///
+/// Completions are submitted with TryEnqueue under the tag "io_uring", so
+/// exceptions they throw go to the pool's error handler. If the pool is
+/// saturated, the poller runs the completion itself instead of waiting for
+/// queue space. Should the ring fail, every in-flight operation completes
+/// with -ECANCELED and later submissions throw.
+///
+/// \note Only available on Linux when the build found io_uring support
+///       (THREADPOOL_HAS_IO_URING is defined).
+/// \note The IoUring must be destroyed before the ThreadPool it dispatches to.
+/// \note This class is not copyable or movable.
+/// \note Thread safety: All operations are thread-safe.
+///
+class IoUring
+{
+public:
+    ///
+    /// \brief Callback receiving the result of an I/O operation
+    ///
+    using Completion = std::function<void(const ssize_t result)>;
+
+    ///
+    /// \brief Creates an io_uring instance and starts its completion poller
+    ///
+    /// \param pool Thread pool on which completions are dispatched
+    /// \param entries Number of submission queue entries (rounded up to a power of two by the kernel)
+    /// \throws std::system_error If the io_uring instance cannot be created or mapped
+    ///
+    IoUring(ThreadPool& pool, const unsigned entries = 256);
+
+    ///
+    /// \brief Destructor - waits for all in-flight operations and stops the poller
+    ///
+    /// Buffers passed to Read and Write stay in use by the kernel until their
+    /// operation completes, so the destructor waits for every in-flight
+    /// operation before the rings are unmapped.
+    ///
+    ~IoUring();
+
+    // Delete copy constructor and assignment operator
+    IoUring(const IoUring&)            = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    ///
+    /// \brief Reads from a file descriptor at the given offset
+    ///
+    /// \param fd File descriptor to read from
+    /// \param buffer Destination buffer, must stay valid until the completion runs
+    /// \param size Number of bytes to read
+    /// \param offset File offset to read at
+    /// \param completion Callback invoked on a pool worker with the result
+    /// \throws std::system_error If the request cannot be submitted
+    ///
+    void Read(const int fd, void* buffer, const size_t size, const uint64_t offset, Completion completion);
+
+    ///
+    /// \brief Reads from a file descriptor and returns the result as a future
+    ///
+    /// \param fd File descriptor to read from
+    /// \param buffer Destination buffer, must stay valid until the future is ready
+    /// \param size Number of bytes to read
+    /// \param offset File offset to read at
+    /// \return std::future<ssize_t> Future holding the number of bytes read or a negated errno value
+    /// \throws std::system_error If the request cannot be submitted
+    ///
+    std::future<ssize_t> Read(const int fd, void* buffer, const size_t size, const uint64_t offset);
+
+    ///
+    /// \brief Writes to a file descriptor at the given offset
+    ///
+    /// \param fd File descriptor to write to
+    /// \param buffer Source buffer, must stay valid until the completion runs
+    /// \param size Number of bytes to write
+    /// \param offset File offset to write at
+    /// \param completion Callback invoked on a pool worker with the result
+    /// \throws std::system_error If the request cannot be submitted
+    ///
+    void Write(const int fd, const void* buffer, const size_t size, const uint64_t offset, Completion completion);
+
+    ///
+    /// \brief Writes to a file descriptor and returns the result as a future
+    ///
+    /// \param fd File descriptor to write to
+    /// \param buffer Source buffer, must stay valid until the future is ready
+    /// \param size Number of bytes to write
+    /// \param offset File offset to write at
+    /// \return std::future<ssize_t> Future holding the number of bytes written or a negated errno value
+    /// \throws std::system_error If the request cannot be submitted
+    ///
+    std::future<ssize_t> Write(const int fd, const void* buffer, const size_t size, const uint64_t offset);
+
+    ///
+    /// \brief Checks whether the running kernel permits io_uring
+    ///
+    /// io_uring may be compiled in but disabled at runtime, e.g. by a seccomp
+    /// profile or the kernel.io_uring_disabled sysctl.
+    ///
+    /// \return bool True if an io_uring instance can be created
+    ///
+    static bool IsSupported();
+
+private:
+    ///
+    /// \brief State of an in-flight operation, referenced by the SQE user data
+    ///
+    struct Operation
+    {
+        Completion completion; ///< Callback to dispatch when the operation completes
+    };
+
+    ThreadPool&             pool_;         ///< Pool on which completions are dispatched
+    int                     ringFd_;       ///< File descriptor of the io_uring instance
+    void*                   ringMemory_;   ///< Mapping of the submission and completion rings
+    size_t                  ringSize_;     ///< Size of the ring mapping
+    io_uring_sqe*           sqes_;         ///< Mapping of the submission queue entries
+    size_t                  sqesSize_;     ///< Size of the submission queue entry mapping
+    unsigned*               sqHead_;       ///< Submission queue head (written by the kernel)
+    unsigned*               sqTail_;       ///< Submission queue tail (written by us)
+    unsigned*               sqMask_;       ///< Submission queue index mask
+    unsigned*               sqArray_;      ///< Submission queue index array
+    unsigned*               cqHead_;       ///< Completion queue head (written by us)
+    unsigned*               cqTail_;       ///< Completion queue tail (written by the kernel)
+    unsigned*               cqMask_;       ///< Completion queue index mask
+    io_uring_cqe*           cqes_;         ///< Completion queue entries
+    size_t                  cqEntries_;    ///< Number of completion queue entries
+    std::mutex              submitMutex_;  ///< Mutex protecting the submission queue
+    std::condition_variable capacity_;     ///< Condition variable for completion queue capacity
+    size_t                  inFlight_;     ///< Number of submitted but not yet reaped operations
+    bool                    stopping_;     ///< Flag indicating shutdown
+    int                     failure_;      ///< errno of the failed io_uring_enter of the poller (zero while the ring works)
+    std::thread             poller_;       ///< Completion poller thread
+
+    std::unordered_set<Operation*> pending_; ///< Operations owned by the ring, failed if the poller stops
+
+    ///
+    /// \brief Places one request on the submission queue and submits it to the kernel
+    ///
+    /// Blocks while the number of in-flight operations equals the completion
+    /// queue size so that completions can never overflow.
+    ///
+    /// \param opcode io_uring operation code
+    /// \param fd File descriptor of the operation
+    /// \param address Buffer address
+    /// \param length Buffer length
+    /// \param offset File offset
+    /// \param operation Operation state, owned by the ring until its completion is reaped
+    /// \throws std::system_error If the kernel rejects the submission or the ring has failed
+    /// \note Thread safety: Acquires and releases the submitMutex_
+    ///
+    void Submit(const uint8_t opcode, const int fd, const uint64_t address, const size_t length, const uint64_t offset, Operation* operation);
+
+    ///
+    /// \brief Main loop of the completion poller thread
+    ///
+    /// Blocks in io_uring_enter until completions arrive, dispatches their
+    /// callbacks to the pool and exits once shutdown was requested and no
+    /// operation is in flight any more. If io_uring_enter fails, the ring is
+    /// marked failed and the pending operations complete with -ECANCELED.
+    ///
+    void ReapCompletions();
+
+    ///
+    /// \brief Runs the completion of an operation on a pool worker
+    ///
+    /// Falls back to running it on the calling poller thread if the pool does
+    /// not accept the task, reporting exceptions to the pool's error handler.
+    ///
+    /// \param operation Operation whose completion to run
+    /// \param result Result passed to the completion
+    ///
+    void Dispatch(std::unique_ptr<Operation> operation, const ssize_t result);
+};
+
+#endif // __THREAD_POOL_IO_URING_H_INCL__
@@ -0,0 +1,442 @@
+///
+/// \file ThreadPoolMemoryResource.cpp
+/// \brief Implementation of the TaskMemoryResource class
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolMemoryResource.h"
+#include <algorithm>
+#include <atomic>
+
+namespace
+{
+constexpr size_t   SizeClassCount  = 10;                                    ///< Size classes of 32 bytes up to 16 KiB
+constexpr size_t   MinBlockSize    = 32;                                    ///< Block size of the smallest size class
+constexpr size_t   MaxBlockSize    = MinBlockSize << (SizeClassCount - 1);  ///< Block size of the largest size class
+constexpr size_t   SlabAlignment   = 64;                                    ///< Alignment of slabs and of blocks of at least this size (one cache line)
+constexpr uint32_t FreelistLimit   = 256;                                   ///< Blocks a thread keeps per size class before rebalancing
+constexpr size_t   FreelistBytes   = 256 * 1024;                            ///< Bytes a thread keeps per size class before rebalancing
+constexpr size_t   ThreadSlotCount = 4;                                     ///< Resources a thread caches blocks for at the same time
+
+///
+/// \brief Free block, linked through its first bytes
+///
+struct Block
+{
+    Block* next; ///< Next free block
+};
+
+size_t SizeClassOf(const size_t bytes)
+{
+    size_t sizeClass = 0;
+    for (size_t blockSize = MinBlockSize; blockSize < bytes; blockSize <<= 1)
+    {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+size_t BlockSizeOf(const size_t sizeClass)
+{
+    return MinBlockSize << sizeClass;
+}
+
+///
+/// \brief Returns whether a request is served from the size classes
+///
+/// Blocks are aligned to their size up to SlabAlignment, so over-aligned
+/// requests up to a cache line are served from the size class of their alignment.
+///
+bool IsPooled(const size_t bytes, const size_t alignment)
+{
+    return bytes <= MaxBlockSize && alignment <= SlabAlignment;
+}
+
+///
+/// \brief Returns the size class serving a request
+///
+size_t SizeClassOf(const size_t bytes, const size_t alignment)
+{
+    return SizeClassOf(std::max(bytes, alignment));
+}
+
+///
+/// \brief Returns the number of blocks a thread keeps in a freelist before rebalancing
+///
+/// Large size classes keep fewer blocks, so that no freelist caches more than FreelistBytes.
+///
+uint32_t FreelistLimitOf(const size_t sizeClass)
+{
+    return static_cast<uint32_t>(std::clamp<size_t>(FreelistBytes / BlockSizeOf(sizeClass), 2, FreelistLimit));
+}
+
+struct ThreadSlot;
+} // namespace
+
+///
+/// \brief State shared between a resource and the thread freelists caching its blocks
+///
+struct TaskMemoryResource::Shared
+{
+    std::mutex               mutex;                       ///< Mutex protecting liveness, registry and released counters
+    bool                     alive = true;                ///< False once the resource is destroyed
+    std::atomic<Block*>      stacks[SizeClassCount] = {}; ///< Lock-free global stack per size class
+    std::vector<ThreadSlot*> slots;                       ///< Thread freelists currently caching blocks
+    uint64_t                 releasedRecycled  = 0;       ///< Recycled allocations of released thread freelists
+    uint64_t                 releasedFresh     = 0;       ///< Fresh allocations of released thread freelists
+    uint64_t                 evictions         = 0;       ///< Thread freelists flushed to make room for another resource
+    std::atomic<uint64_t>    unattributedFresh = 0;       ///< Fresh allocations made without a thread freelist
+    std::atomic<size_t>      reservedBytes     = 0;       ///< Bytes of slabs reserved from the upstream resource
+
+    ///
+    /// \brief Pushes a chain of blocks onto the global stack of a size class
+    ///
+    /// A Treiber push, which is not subject to the ABA problem since blocks are
+    /// only ever removed by taking the whole stack.
+    ///
+    void PushChain(const size_t sizeClass, Block* first, Block* last)
+    {
+        Block* head = stacks[sizeClass].load(std::memory_order_relaxed);
+        do
+        {
+            last->next = head;
+        }
+        while (false == stacks[sizeClass].compare_exchange_weak(head, first, std::memory_order_release, std::memory_order_relaxed));
+    }
+};
+
+namespace
+{
+///
+/// \brief Freelists of one thread for one resource
+///
+struct ThreadSlot
+{
+    std::shared_ptr<TaskMemoryResource::Shared> shared;                      ///< Resource the blocks belong to (nullptr if unused)
+    Block*                                      heads[SizeClassCount]  = {}; ///< Freelist per size class
+    uint32_t                                    counts[SizeClassCount] = {}; ///< Length of each freelist
+    std::atomic<uint64_t>                       recycled               = 0;  ///< Recycled allocations (written by the owning thread only)
+    std::atomic<uint64_t>                       fresh                  = 0;  ///< Fresh allocations (written by the owning thread only)
+    uint64_t                                    lastUse                = 0;  ///< Use stamp of the owning thread's cache, for LRU eviction
+
+    ///
+    /// \brief Hands all cached blocks back to the resource and detaches from it
+    ///
+    /// \param evicted True if the slot is released to cache another resource
+    ///
+    void Release(const bool evicted = false)
+    {
+        if (nullptr == shared)
+        {
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(shared->mutex);
+
+            // Blocks of a destroyed resource belong to returned slabs - abandon them untouched
+            if (true == shared->alive)
+            {
+                for (size_t sizeClass = 0; sizeClass < SizeClassCount; ++sizeClass)
+                {
+                    if (nullptr != heads[sizeClass])
+                    {
+                        Block* last = heads[sizeClass];
+                        while (nullptr != last->next)
+                        {
+                            last = last->next;
+                        }
+                        shared->PushChain(sizeClass, heads[sizeClass], last);
+                    }
+                }
+            }
+
+            shared->releasedRecycled += recycled.load(std::memory_order_relaxed);
+            shared->releasedFresh += fresh.load(std::memory_order_relaxed);
+            shared->evictions += (true == evicted) ? 1 : 0;
+            shared->slots.erase(std::find(shared->slots.begin(), shared->slots.end(), this));
+        }
+
+        std::fill(std::begin(heads), std::end(heads), nullptr);
+        std::fill(std::begin(counts), std::end(counts), 0);
+        recycled.store(0, std::memory_order_relaxed);
+        fresh.store(0, std::memory_order_relaxed);
+        lastUse = 0;
+        shared.reset();
+    }
+
+    ///
+    /// \brief Attaches the slot to a resource
+    ///
+    void Attach(const std::shared_ptr<TaskMemoryResource::Shared>& resourceShared)
+    {
+        shared = resourceShared;
+
+        std::unique_lock<std::mutex> lock(shared->mutex);
+        shared->slots.push_back(this);
+    }
+
+    ///
+    /// \brief Counts an allocation (only called by the owning thread, so no read-modify-write is needed)
+    ///
+    static void Count(std::atomic<uint64_t>& counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+///
+/// \brief Freelists of the calling thread for the resources it uses
+///
+struct ThreadCache
+{
+    ThreadSlot slots[ThreadSlotCount]; ///< One slot per cached resource
+    uint64_t   useClock = 0;           ///< Stamp of the most recent slot lookup
+
+    ~ThreadCache();
+};
+
+thread_local ThreadCache threadCache;
+thread_local bool        threadCacheDestroyed = false;
+
+ThreadCache::~ThreadCache()
+{
+    // Give the cached blocks back so that other threads can reuse them
+    for (ThreadSlot& slot : slots)
+    {
+        slot.Release();
+    }
+    threadCacheDestroyed = true;
+}
+
+///
+/// \brief Finds or creates the calling thread's freelists for a resource
+///
+/// \param shared Shared state of the resource
+/// \return ThreadSlot* Freelists of the calling thread, or nullptr if the thread is exiting
+///
+ThreadSlot* AcquireSlot(const std::shared_ptr<TaskMemoryResource::Shared>& shared)
+{
+    if (true == threadCacheDestroyed)
+    {
+        return nullptr;
+    }
+
+    ThreadCache& cache = threadCache;
+    cache.useClock++;
+    for (ThreadSlot& slot : cache.slots)
+    {
+        if (slot.shared == shared)
+        {
+            slot.lastUse = cache.useClock;
+            return &slot;
+        }
+    }
+
+    // Take a free slot, or else evict the least recently used one, so that a
+    // thread alternating between more resources than slots keeps its busiest ones
+    ThreadSlot* victim = &cache.slots[0];
+    for (ThreadSlot& slot : cache.slots)
+    {
+        if (nullptr == slot.shared)
+        {
+            victim = &slot;
+            break;
+        }
+        if (slot.lastUse < victim->lastUse)
+        {
+            victim = &slot;
+        }
+    }
+
+    if (nullptr != victim->shared)
+    {
+        victim->Release(true);
+    }
+    victim->Attach(shared);
+    victim->lastUse = cache.useClock;
+    return victim;
+}
+} // namespace
+
+double TaskMemoryResource::Statistics::HitRate() const
+{
+    const uint64_t allocations = recycledAllocations + freshAllocations;
+    if (0 == allocations)
+    {
+        return 0.0;
+    }
+
+    return static_cast<double>(recycledAllocations) / static_cast<double>(allocations);
+}
+
+TaskMemoryResource::TaskMemoryResource(std::pmr::memory_resource* upstream, const size_t slabSize) :
+    shared_(std::make_shared<Shared>()), upstream_(upstream), slabSize_(std::max(slabSize, MaxBlockSize)), slabCursor_(nullptr), slabEnd_(nullptr)
+{
+}
+
+TaskMemoryResource::~TaskMemoryResource()
+{
+    // Mark the resource as gone first, so that threads still caching blocks
+    // abandon them instead of touching the slabs released below
+    {
+        std::unique_lock<std::mutex> lock(shared_->mutex);
+        shared_->alive = false;
+    }
+
+    for (void* slab : slabs_)
+    {
+        upstream_->deallocate(slab, slabSize_, SlabAlignment);
+    }
+}
+
+TaskMemoryResource* TaskMemoryResource::Default()
+{
+    // Intentionally never destroyed: futures may outlive their pool and release
+    // their shared state during static destruction
+    static TaskMemoryResource* const instance = new TaskMemoryResource();
+    return instance;
+}
+
+TaskMemoryResource::Statistics TaskMemoryResource::GetStatistics() const
+{
+    std::unique_lock<std::mutex> lock(shared_->mutex);
+
+    Statistics statistics;
+    statistics.recycledAllocations = shared_->releasedRecycled;
+    statistics.freshAllocations    = shared_->releasedFresh + shared_->unattributedFresh.load(std::memory_order_relaxed);
+    statistics.reservedBytes       = shared_->reservedBytes.load(std::memory_order_relaxed);
+    statistics.evictions           = shared_->evictions;
+
+    // Registered slots cannot detach while we hold the mutex
+    for (const ThreadSlot* slot : shared_->slots)
+    {
+        statistics.recycledAllocations += slot->recycled.load(std::memory_order_relaxed);
+        statistics.freshAllocations += slot->fresh.load(std::memory_order_relaxed);
+    }
+
+    return statistics;
+}
+
+void* TaskMemoryResource::do_allocate(size_t bytes, size_t alignment)
+{
+    // Oversized or over-aligned requests bypass the size classes
+    if (false == IsPooled(bytes, alignment))
+    {
+        shared_->unattributedFresh.fetch_add(1, std::memory_order_relaxed);
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    const size_t sizeClass = SizeClassOf(bytes, alignment);
+    ThreadSlot*  slot      = AcquireSlot(shared_);
+
+    // The thread is exiting and has no freelists any more
+    if (nullptr == slot)
+    {
+        shared_->unattributedFresh.fetch_add(1, std::memory_order_relaxed);
+        return CarveBlock(BlockSizeOf(sizeClass));
+    }
+
+    // Local freelist ran dry - take everything other threads handed back
+    if (nullptr == slot->heads[sizeClass])
+    {
+        Block* chain = shared_->stacks[sizeClass].exchange(nullptr, std::memory_order_acquire);
+        if (nullptr == chain)
+        {
+            ThreadSlot::Count(slot->fresh);
+            return CarveBlock(BlockSizeOf(sizeClass));
+        }
+
+        uint32_t count = 0;
+        for (Block* block = chain; nullptr != block; block = block->next)
+        {
+            count++;
+        }
+        slot->heads[sizeClass]  = chain;
+        slot->counts[sizeClass] = count;
+    }
+
+    Block* block           = slot->heads[sizeClass];
+    slot->heads[sizeClass] = block->next;
+    slot->counts[sizeClass]--;
+    ThreadSlot::Count(slot->recycled);
+    return block;
+}
+
+void TaskMemoryResource::do_deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    if (false == IsPooled(bytes, alignment))
+    {
+        upstream_->deallocate(pointer, bytes, alignment);
+        return;
+    }
+
+    const size_t sizeClass = SizeClassOf(bytes, alignment);
+    Block*       block     = static_cast<Block*>(pointer);
+    ThreadSlot*  slot      = AcquireSlot(shared_);
+
+    // The thread is exiting - hand the block back directly
+    if (nullptr == slot)
+    {
+        shared_->PushChain(sizeClass, block, block);
+        return;
+    }
+
+    // Free to the local freelist of the completing thread
+    block->next            = slot->heads[sizeClass];
+    slot->heads[sizeClass] = block;
+    slot->counts[sizeClass]++;
+
+    // Rebalance: move half of an overlong freelist to the global stack, where
+    // producers whose freelists run dry pick it up
+    const uint32_t limit = FreelistLimitOf(sizeClass);
+    if (slot->counts[sizeClass] > limit)
+    {
+        Block* first = slot->heads[sizeClass];
+        Block* last  = first;
+        for (uint32_t i = 1; i < limit / 2; ++i)
+        {
+            last = last->next;
+        }
+
+        slot->heads[sizeClass] = last->next;
+        slot->counts[sizeClass] -= limit / 2;
+        shared_->PushChain(sizeClass, first, last);
+    }
+}
+
+bool TaskMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void* TaskMemoryResource::CarveBlock(const size_t blockSize)
+{
+    std::unique_lock<std::mutex> lock(slabMutex_);
+
+    // Align the block to its size up to a cache line; blocks are powers of two,
+    // so padding only occurs where a smaller block precedes a larger one
+    const size_t alignment = std::min(blockSize, SlabAlignment);
+    const size_t padding   = (nullptr == slabCursor_) ? 0 : (alignment - reinterpret_cast<uintptr_t>(slabCursor_) % alignment) % alignment;
+
+    // Reserve a new slab once the current one is exhausted; the remainder of
+    // the old slab is too small for this block and is left unused
+    if (nullptr == slabCursor_ || static_cast<size_t>(slabEnd_ - slabCursor_) < padding + blockSize)
+    {
+        void* slab = upstream_->allocate(slabSize_, SlabAlignment);
+        slabs_.push_back(slab);
+        slabCursor_ = static_cast<char*>(slab);
+        slabEnd_    = slabCursor_ + slabSize_;
+        shared_->reservedBytes.fetch_add(slabSize_, std::memory_order_relaxed);
+    }
+    else
+    {
+        slabCursor_ += padding;
+    }
+
+    void* block = slabCursor_;
+    slabCursor_ += blockSize;
+    return block;
+}
@@ -0,0 +1,137 @@
+///
+/// \file ThreadPoolMemoryResource.h
+/// \brief Recycling memory resource for task nodes and future shared states
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_MEMORY_RESOURCE_H_INCL__
+#define __THREAD_POOL_MEMORY_RESOURCE_H_INCL__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+///
+/// \brief Size-classed memory resource that recycles blocks through per-thread freelists
+///
+/// Task state is typically allocated by a producer thread and freed by the
+/// worker that completed the task, which defeats the thread caches of most
+/// malloc implementations. TaskMemoryResource serves small blocks from
+/// per-thread, size-classed freelists instead. Blocks freed on a worker go to
+/// that worker's freelist; once it grows beyond a limit, half of it is moved to
+/// a lock-free global stack per size class, from which threads whose freelist
+/// ran dry take the whole stack at once. In steady state, submit/complete
+/// cycles then perform no upstream allocation at all.
+///
+/// Blocks are carved from slabs allocated from the upstream resource, which
+/// are returned to it when the resource is destroyed. Size classes range from
+/// 32 bytes to 16 KiB and blocks are aligned to their size up to a cache line,
+/// so over-aligned requests up to 64 bytes are recycled as well. Larger
+/// requests or stricter alignments go to the upstream directly.
+///
+/// \note Like every memory resource, it must outlive all memory allocated from
+///       it. TaskMemoryResource::Default() is never destroyed and can therefore
+///       back futures that outlive their pool.
+/// \note Thread safety: All operations are thread-safe.
+///
+class TaskMemoryResource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t DefaultSlabSize = 256 * 1024; ///< Bytes reserved from the upstream resource at once by default
+
+    ///
+    /// \brief Allocation counters of a TaskMemoryResource
+    ///
+    struct Statistics
+    {
+        uint64_t recycledAllocations; ///< Allocations served from a previously freed block
+        uint64_t freshAllocations;    ///< Allocations that needed a new block or an upstream allocation
+        size_t   reservedBytes;       ///< Bytes of slabs reserved from the upstream resource
+        uint64_t evictions;           ///< Thread freelists flushed because their thread needed the slot for another resource
+
+        ///
+        /// \brief Fraction of allocations served by recycling
+        ///
+        /// \return double Hit rate between 0 and 1 (zero if nothing was allocated)
+        ///
+        double HitRate() const;
+    };
+
+    ///
+    /// \brief Creates a recycling resource on top of an upstream resource
+    ///
+    /// \param upstream Resource for slabs and oversized requests, must outlive this resource
+    /// \param slabSize Bytes reserved from the upstream resource at once (e.g. one huge page)
+    ///
+    explicit TaskMemoryResource(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource(), const size_t slabSize = DefaultSlabSize);
+
+    ///
+    /// \brief Destructor - returns all slabs to the upstream resource
+    ///
+    /// Blocks still cached by other threads are abandoned without being touched.
+    ///
+    ~TaskMemoryResource() override;
+
+    // Delete copy constructor and assignment operator
+    TaskMemoryResource(const TaskMemoryResource&)            = delete;
+    TaskMemoryResource& operator=(const TaskMemoryResource&) = delete;
+
+    ///
+    /// \brief Process-wide instance used by thread pools by default
+    ///
+    /// \return TaskMemoryResource* Instance that is never destroyed
+    ///
+    static TaskMemoryResource* Default();
+
+    ///
+    /// \brief Returns the allocation counters
+    ///
+    /// A thread caches freelists for four resources at a time and flushes the
+    /// least recently used one when it touches a fifth; frequent evictions mean
+    /// that threads spread their tasks over too many resources. The counters of
+    /// Default() are process-wide: they cover every pool and container using the
+    /// default instance, so its hit rate is not that of a single pool.
+    ///
+    /// \return Statistics Counters summed over all threads that used this resource
+    /// \note Thread safety: Acquires and releases the internal registry mutex
+    ///
+    Statistics GetStatistics() const;
+
+    ///
+    /// \brief State shared with the per-thread freelists
+    ///
+    /// Defined in the implementation; kept alive by the freelists of threads
+    /// that used the resource so that they can tell whether it still exists.
+    ///
+    struct Shared;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    std::shared_ptr<Shared>    shared_;     ///< Liveness, global stacks and counters shared with thread freelists
+    std::pmr::memory_resource* upstream_;   ///< Resource for slabs and oversized requests
+    const size_t               slabSize_;   ///< Bytes reserved from the upstream resource at once
+    std::mutex                 slabMutex_;  ///< Mutex protecting the slabs
+    std::vector<void*>         slabs_;      ///< Slabs reserved from the upstream resource
+    char*                      slabCursor_; ///< Next free byte of the current slab
+    char*                      slabEnd_;    ///< End of the current slab
+
+    ///
+    /// \brief Carves a new block of the given size class from the current slab
+    ///
+    /// \param blockSize Size of the block in bytes
+    /// \return void* New block
+    /// \note Thread safety: Acquires and releases the slabMutex_
+    ///
+    void* CarveBlock(const size_t blockSize);
+};
+
+#endif // __THREAD_POOL_MEMORY_RESOURCE_H_INCL__
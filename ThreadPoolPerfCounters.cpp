@@ -0,0 +1,228 @@
+///
+/// \file ThreadPoolPerfCounters.cpp
+/// \brief Implementation of the PerfCounterGroup class
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolPerfCounters.h"
+#include <atomic>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+///
+/// \brief Opens one counter of the calling thread
+///
+/// \return int File descriptor, or -1 if the kernel refuses the counter
+///
+int OpenCounter(const uint32_t type, const uint64_t config, const bool excludeKernel, const int groupFd)
+{
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size           = sizeof(attributes);
+    attributes.type           = type;
+    attributes.config         = config;
+    attributes.read_format    = PERF_FORMAT_GROUP;
+    attributes.exclude_kernel = (true == excludeKernel) ? 1 : 0;
+    attributes.exclude_hv     = 1;
+
+    return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+}
+
+///
+/// \brief Reads a hardware counter register in user space
+///
+/// \return bool False on architectures without a user-space counter instruction
+///
+bool ReadCounterRegister(const uint32_t index, uint64_t& value)
+{
+#if defined(__x86_64__)
+    uint32_t low  = 0;
+    uint32_t high = 0;
+    __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index));
+    value = (static_cast<uint64_t>(high) << 32) | low;
+    return true;
+#else
+    static_cast<void>(index);
+    static_cast<void>(value);
+    return false;
+#endif
+}
+
+///
+/// \brief Reads one counter from its user page, retrying while the kernel updates it
+///
+/// Follows the protocol documented in linux/perf_event.h: the page is guarded by
+/// a sequence count, and a scheduled counter's value is the page's offset plus
+/// the sign-extended register. Software counters are never scheduled on a
+/// register; their offset is their value.
+///
+/// \return bool False if a hardware counter is not readable in user space right now
+///
+bool ReadUserPage(const perf_event_mmap_page* page, const bool hardware, uint64_t& value)
+{
+    const volatile perf_event_mmap_page* const shared = page;
+
+    uint32_t sequence = 0;
+    do
+    {
+        sequence = shared->lock;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+
+        const uint32_t index = shared->index;
+        value                = static_cast<uint64_t>(shared->offset);
+        if (true == hardware)
+        {
+            uint64_t counter = 0;
+            if (0 == index || 0 == shared->cap_user_rdpmc || false == ReadCounterRegister(index - 1, counter))
+            {
+                return false;
+            }
+
+            const uint32_t shift = 64 - shared->pmc_width;
+            value += static_cast<uint64_t>(static_cast<int64_t>(counter << shift) >> shift);
+        }
+
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    while (shared->lock != sequence);
+
+    return true;
+}
+} // namespace
+
+PerfCounterGroup::PerfCounterGroup() : leader_(-1), memberCount_(0), usageSwitches_(false)
+{
+    fds_.fill(-1);
+    pages_.fill(nullptr);
+    groupIndex_.fill(0);
+
+    struct Event
+    {
+        uint32_t type;
+        uint64_t config;
+        bool     excludeKernel;
+    };
+
+    // Hardware counters need no kernel profiling rights since they exclude the kernel;
+    // context switches only happen in the kernel and are counted including it
+    const Event events[CounterCount] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, true},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, true},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, true},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, false},
+    };
+
+    // The first counter the kernel accepts leads the group, the others join it
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    for (size_t counter = 0; counter < CounterCount; ++counter)
+    {
+        const int fd = OpenCounter(events[counter].type, events[counter].config, events[counter].excludeKernel, leader_);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        if (leader_ < 0)
+        {
+            leader_ = fd;
+        }
+        fds_[counter]        = fd;
+        groupIndex_[counter] = memberCount_++;
+
+        // Without a user page, reads go through the group leader
+        void* page = mmap(nullptr, static_cast<size_t>(pageSize), PROT_READ, MAP_SHARED, fd, 0);
+        if (MAP_FAILED != page)
+        {
+            pages_[counter] = static_cast<perf_event_mmap_page*>(page);
+        }
+    }
+
+    usageSwitches_ = (fds_[ContextSwitches] < 0);
+}
+
+PerfCounterGroup::~PerfCounterGroup()
+{
+    const long pageSize = sysconf(_SC_PAGESIZE);
+
+    // Members are closed before the leader
+    for (size_t counter = CounterCount; counter-- > 0;)
+    {
+        if (nullptr != pages_[counter])
+        {
+            munmap(pages_[counter], static_cast<size_t>(pageSize));
+        }
+        if (fds_[counter] >= 0)
+        {
+            close(fds_[counter]);
+        }
+    }
+}
+
+bool PerfCounterGroup::IsAvailable(const Counter counter) const
+{
+    return fds_[counter] >= 0 || (ContextSwitches == counter && true == usageSwitches_);
+}
+
+bool PerfCounterGroup::Read(Values& values) const
+{
+    values.fill(0);
+    if (leader_ >= 0 && false == ReadUserPages(values) && false == ReadGroup(values))
+    {
+        return false;
+    }
+
+    if (true == usageSwitches_)
+    {
+        rusage usage;
+        if (0 == getrusage(RUSAGE_THREAD, &usage))
+        {
+            values[ContextSwitches] = static_cast<uint64_t>(usage.ru_nvcsw) + static_cast<uint64_t>(usage.ru_nivcsw);
+        }
+    }
+    return true;
+}
+
+bool PerfCounterGroup::ReadUserPages(Values& values) const
+{
+    for (size_t counter = 0; counter < CounterCount; ++counter)
+    {
+        if (fds_[counter] < 0)
+        {
+            continue;
+        }
+
+        if (nullptr == pages_[counter] || false == ReadUserPage(pages_[counter], ContextSwitches != counter, values[counter]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PerfCounterGroup::ReadGroup(Values& values) const
+{
+    // PERF_FORMAT_GROUP: the number of members followed by their values in group order
+    uint64_t buffer[1 + CounterCount] {};
+    const ssize_t bytes = read(leader_, buffer, sizeof(buffer));
+    if (bytes < static_cast<ssize_t>(sizeof(uint64_t) * (1 + memberCount_)))
+    {
+        return false;
+    }
+
+    for (size_t counter = 0; counter < CounterCount; ++counter)
+    {
+        if (fds_[counter] >= 0)
+        {
+            values[counter] = buffer[1 + groupIndex_[counter]];
+        }
+    }
+    return true;
+}
@@ -0,0 +1,115 @@
+///
+/// \file ThreadPoolPerfCounters.h
+/// \brief Hardware and software performance counters of the calling thread
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_PERF_COUNTERS_H_INCL__
+#define __THREAD_POOL_PERF_COUNTERS_H_INCL__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+struct perf_event_mmap_page;
+
+///
+/// \brief Group of perf_event_open counters measuring the thread that created it
+///
+/// Opens CPU cycles, instructions and last-level cache misses (user space
+/// only) plus context switches as one counter group. Every counter is mapped
+/// into user space, so Read() usually costs a few rdpmc instructions instead of
+/// a system call:
+///
+/// 1. rdpmc, if the architecture supports it (x86-64), the kernel allows it
+///    (cap_user_rdpmc) and the hardware counters are currently scheduled
+/// 2. A single read() of the whole group otherwise
+///
+/// Counters the kernel refuses (kernel.perf_event_paranoid, no PMU in a
+/// virtual machine or container) are left out and read as zero. Context
+/// switches happen in the kernel, so counting them needs kernel profiling
+/// rights (paranoid <= 1 or CAP_PERFMON); without them they are taken from
+/// getrusage(RUSAGE_THREAD) at the cost of a system call per read. So even
+/// where perf_event_open is forbidden entirely, context switches are counted.
+///
+/// Counts are not scaled: if more counters are in use system-wide than the
+/// PMU has, they only cover the time the group was scheduled.
+///
+/// \note Only available on Linux (THREADPOOL_HAS_PERF_COUNTERS is defined).
+/// \note Thread safety: An instance must only be used by the thread that created it.
+///
+class PerfCounterGroup
+{
+public:
+    ///
+    /// \brief Counters of the group, in the order of Values
+    ///
+    enum Counter : size_t
+    {
+        Cycles,          ///< CPU cycles in user space
+        Instructions,    ///< Instructions retired in user space
+        CacheMisses,     ///< Last-level cache misses in user space
+        ContextSwitches, ///< Context switches of the thread
+        CounterCount
+    };
+
+    using Values = std::array<uint64_t, CounterCount>; ///< Counter values indexed by Counter
+
+    ///
+    /// \brief Opens the counters for the calling thread and starts counting
+    ///
+    PerfCounterGroup();
+
+    ///
+    /// \brief Closes and unmaps all counters
+    ///
+    ~PerfCounterGroup();
+
+    // Delete copy constructor and assignment operator
+    PerfCounterGroup(const PerfCounterGroup&)            = delete;
+    PerfCounterGroup& operator=(const PerfCounterGroup&) = delete;
+
+    ///
+    /// \brief Checks whether a counter is open
+    ///
+    /// \param counter Counter to check
+    /// \return bool True if the counter is counted, false if it reads as zero
+    ///
+    bool IsAvailable(const Counter counter) const;
+
+    ///
+    /// \brief Reads the current values of all counters
+    ///
+    /// \param values Receives the values (zero for counters that are not open)
+    /// \return bool True on success, false if the group could not be read
+    ///
+    bool Read(Values& values) const;
+
+private:
+    std::array<int, CounterCount>                   fds_;           ///< File descriptor per counter (-1 if not open)
+    std::array<perf_event_mmap_page*, CounterCount> pages_;         ///< User page per counter (nullptr if not mapped)
+    std::array<size_t, CounterCount>                groupIndex_;    ///< Position of each counter in a group read
+    int                                             leader_;        ///< File descriptor of the group leader (-1 if none is open)
+    size_t                                          memberCount_;   ///< Number of open counters
+    bool                                            usageSwitches_; ///< True if context switches come from getrusage instead of a counter
+
+    ///
+    /// \brief Reads all counters from their user pages without a system call
+    ///
+    /// \param values Receives the values
+    /// \return bool True on success, false if a hardware counter cannot be read in user space right now
+    ///
+    bool ReadUserPages(Values& values) const;
+
+    ///
+    /// \brief Reads all counters with one read() of the group leader
+    ///
+    /// \param values Receives the values
+    /// \return bool True on success
+    ///
+    bool ReadGroup(Values& values) const;
+};
+
+#endif // __THREAD_POOL_PERF_COUNTERS_H_INCL__
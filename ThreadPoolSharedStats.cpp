@@ -0,0 +1,214 @@
+///
+/// \file ThreadPoolSharedStats.cpp
+/// \brief Implementation of the SharedStatsSegment class
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolSharedStats.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr char SharedStatsMagic[8] = {'T', 'P', 'S', 'T', 'A', 'T', 'S', '\0'};
+
+///
+/// \brief Attempts of a reader before it gives up on a writer that keeps updating
+///
+constexpr int ReadAttempts = 1000;
+} // namespace
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the segment is shared between processes and needs address-free atomics");
+
+SharedStatsSegment::~SharedStatsSegment()
+{
+    if (nullptr != mapping_)
+    {
+        munmap(mapping_, size_);
+    }
+    if (name_.empty() == false)
+    {
+        shm_unlink(name_.c_str());
+    }
+}
+
+bool SharedStatsSegment::Create(const std::string& name, const uint32_t workerCount, const int64_t interval)
+{
+    // A segment left behind by a crashed process of the same name is replaced
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    const size_t size = sizeof(SharedStatsHeader) + workerCount * sizeof(SharedStatsWorker);
+    void*        mapping =
+        (0 == ftruncate(fd, static_cast<off_t>(size))) ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (MAP_FAILED == mapping)
+    {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // The new file is zero-filled, which is a valid state for every atomic counter
+    mapping_                  = mapping;
+    size_                     = size;
+    name_                     = name;
+    SharedStatsHeader& header = Header();
+    header.version            = SharedStatsVersion;
+    header.headerSize         = sizeof(SharedStatsHeader);
+    header.workerSize         = sizeof(SharedStatsWorker);
+    header.workerCount        = workerCount;
+    header.pid                = static_cast<uint64_t>(getpid());
+    header.interval           = interval;
+
+    // Readers check the magic first, so it is published after the rest of the identification
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header.magic, SharedStatsMagic, sizeof(SharedStatsMagic));
+    return true;
+}
+
+bool SharedStatsSegment::Attach(const std::string& name)
+{
+    const int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat status;
+    void*       mapping = MAP_FAILED;
+    if (0 == fstat(fd, &status) && static_cast<size_t>(status.st_size) >= sizeof(SharedStatsHeader))
+    {
+        mapping = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (MAP_FAILED == mapping)
+    {
+        return false;
+    }
+
+    // Newer writers may append fields; only the layout version and the sizes this reader knows matter
+    const SharedStatsHeader& header = *static_cast<const SharedStatsHeader*>(mapping);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const size_t size = static_cast<size_t>(status.st_size);
+    if (0 != std::memcmp(header.magic, SharedStatsMagic, sizeof(SharedStatsMagic)) || SharedStatsVersion != header.version ||
+        header.headerSize < sizeof(SharedStatsHeader) || header.workerSize < sizeof(SharedStatsWorker) ||
+        size < header.headerSize + static_cast<size_t>(header.workerCount) * header.workerSize)
+    {
+        munmap(mapping, size);
+        return false;
+    }
+
+    mapping_ = mapping;
+    size_    = size;
+    return true;
+}
+
+SharedStatsHeader& SharedStatsSegment::Header() const
+{
+    return *static_cast<SharedStatsHeader*>(mapping_);
+}
+
+SharedStatsWorker& SharedStatsSegment::Worker(const size_t worker) const
+{
+    const SharedStatsHeader& header = Header();
+    return *reinterpret_cast<SharedStatsWorker*>(static_cast<char*>(mapping_) + header.headerSize + worker * header.workerSize);
+}
+
+const std::string& SharedStatsSegment::Name() const
+{
+    return name_;
+}
+
+void SharedStatsSegment::BeginUpdate()
+{
+    SharedStatsHeader& header = Header();
+    header.sequence.store(header.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void SharedStatsSegment::EndUpdate()
+{
+    SharedStatsHeader& header = Header();
+    header.sequence.store(header.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool SharedStatsSegment::Read(SharedStatsSnapshot& snapshot) const
+{
+    const SharedStatsHeader& header = Header();
+    snapshot.workers.resize(header.workerCount);
+
+    for (int attempt = 0; attempt < ReadAttempts; ++attempt)
+    {
+        const uint64_t sequence = header.sequence.load(std::memory_order_acquire);
+        if (0 != (sequence & 1))
+        {
+            continue;
+        }
+
+        snapshot.pid                 = header.pid;
+        snapshot.interval            = header.interval;
+        snapshot.sequence            = sequence;
+        snapshot.timestamp           = header.timestamp.load(std::memory_order_relaxed);
+        snapshot.queuedTasks         = header.queuedTasks.load(std::memory_order_relaxed);
+        snapshot.activeTasks         = header.activeTasks.load(std::memory_order_relaxed);
+        snapshot.parkedWorkers       = header.parkedWorkers.load(std::memory_order_relaxed);
+        snapshot.overloaded          = (0 != header.overloaded.load(std::memory_order_relaxed));
+        snapshot.rejectedTasks       = header.rejectedTasks.load(std::memory_order_relaxed);
+        snapshot.stolenTasks         = header.stolenTasks.load(std::memory_order_relaxed);
+        snapshot.unhandledExceptions = header.unhandledExceptions.load(std::memory_order_relaxed);
+        snapshot.stuckTasks          = header.stuckTasks.load(std::memory_order_relaxed);
+        snapshot.lastSojournTime     = header.lastSojournTime.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < SharedStatsBuckets; ++bucket)
+        {
+            snapshot.sojourn[bucket] = header.sojourn[bucket].load(std::memory_order_relaxed);
+        }
+        for (size_t worker = 0; worker < snapshot.workers.size(); ++worker)
+        {
+            const SharedStatsWorker& entry = Worker(worker);
+            snapshot.workers[worker]       = SharedStatsWorkerData {entry.tasks.load(std::memory_order_relaxed),
+                      entry.runningTime.load(std::memory_order_relaxed), entry.parkedTime.load(std::memory_order_relaxed),
+                      entry.cpuTime.load(std::memory_order_relaxed), entry.queueDepth.load(std::memory_order_relaxed)};
+        }
+
+        // The copy is consistent if no update started while it was taken
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header.sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            return 0 != sequence;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> SharedStatsSegment::List()
+{
+    std::vector<std::string> names;
+    DIR*                     directory = opendir("/dev/shm");
+    if (nullptr == directory)
+    {
+        return names;
+    }
+
+    const std::string prefix = NamePrefix + 1;
+    while (const dirent* entry = readdir(directory))
+    {
+        if (0 == std::strncmp(entry->d_name, prefix.c_str(), prefix.size()))
+        {
+            names.push_back(std::string("/") + entry->d_name);
+        }
+    }
+    closedir(directory);
+    std::sort(names.begin(), names.end());
+    return names;
+}
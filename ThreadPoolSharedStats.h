@@ -0,0 +1,206 @@
+///
+/// \file ThreadPoolSharedStats.h
+/// \brief Shared-memory segment through which a pool publishes its statistics
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_SHARED_STATS_H_INCL__
+#define __THREAD_POOL_SHARED_STATS_H_INCL__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+///
+/// \brief Version of the segment layout, incremented on every incompatible change
+///
+/// Compatible extensions append fields to SharedStatsHeader or SharedStatsWorker
+/// and are detected through their size fields.
+///
+constexpr uint32_t SharedStatsVersion = 1;
+
+///
+/// \brief Number of buckets of the sojourn time histogram
+///
+/// Bucket b counts sojourn times t with 2^(b-1) <= t < 2^b nanoseconds (bucket
+/// zero counts zero); the last bucket also counts everything above.
+///
+constexpr size_t SharedStatsBuckets = 40;
+
+///
+/// \brief Start of the segment: identification, pool counters and histogram
+///
+/// The identification is written once before the magic; everything after
+/// sequence is protected by it.
+///
+struct SharedStatsHeader
+{
+    char                  magic[8];                    ///< "TPSTATS" followed by a zero byte, written last
+    uint32_t              version;                     ///< SharedStatsVersion of the writer
+    uint32_t              headerSize;                  ///< sizeof(SharedStatsHeader) of the writer
+    uint32_t              workerSize;                  ///< sizeof(SharedStatsWorker) of the writer
+    uint32_t              workerCount;                 ///< Number of SharedStatsWorker entries after the header
+    uint64_t              pid;                         ///< Process id of the writer
+    int64_t               interval;                    ///< Publishing interval in nanoseconds
+    std::atomic<uint64_t> sequence;                    ///< Seqlock: odd while an update is being written
+    std::atomic<int64_t>  timestamp;                   ///< CLOCK_MONOTONIC nanoseconds of the last update
+    std::atomic<uint64_t> queuedTasks;                 ///< Tasks waiting in the worker queues
+    std::atomic<uint64_t> activeTasks;                 ///< Tasks currently executing
+    std::atomic<uint64_t> parkedWorkers;               ///< Workers waiting for tasks
+    std::atomic<uint64_t> overloaded;                  ///< One while admission control rejects tasks
+    std::atomic<uint64_t> rejectedTasks;               ///< Tasks rejected by TryEnqueue
+    std::atomic<uint64_t> stolenTasks;                 ///< Tasks taken from another worker's queue
+    std::atomic<uint64_t> unhandledExceptions;         ///< Exceptions passed to the error sink
+    std::atomic<uint64_t> stuckTasks;                  ///< Tasks reported by the watchdog
+    std::atomic<int64_t>  lastSojournTime;             ///< Sojourn time of the most recently dequeued task in nanoseconds
+    std::atomic<uint64_t> sojourn[SharedStatsBuckets]; ///< Sojourn time histogram of all dequeued tasks
+};
+
+///
+/// \brief Counters of one worker, following the header
+///
+struct SharedStatsWorker
+{
+    std::atomic<uint64_t> tasks;       ///< Tasks run
+    std::atomic<int64_t>  runningTime; ///< Nanoseconds spent running tasks
+    std::atomic<int64_t>  parkedTime;  ///< Nanoseconds spent parked or in epoll_wait
+    std::atomic<int64_t>  cpuTime;     ///< CPU time of the thread in nanoseconds
+    std::atomic<uint64_t> queueDepth;  ///< Tasks in the worker's queue
+};
+
+///
+/// \brief Consistent copy of one worker's counters
+///
+struct SharedStatsWorkerData
+{
+    uint64_t tasks;       ///< Tasks run
+    int64_t  runningTime; ///< Nanoseconds spent running tasks
+    int64_t  parkedTime;  ///< Nanoseconds spent parked or in epoll_wait
+    int64_t  cpuTime;     ///< CPU time of the thread in nanoseconds
+    uint64_t queueDepth;  ///< Tasks in the worker's queue
+};
+
+///
+/// \brief Consistent copy of a segment
+///
+struct SharedStatsSnapshot
+{
+    uint64_t                           pid;                         ///< Process id of the writer
+    int64_t                            interval;                    ///< Publishing interval in nanoseconds
+    uint64_t                           sequence;                    ///< Sequence number of the update
+    int64_t                            timestamp;                   ///< CLOCK_MONOTONIC nanoseconds of the update
+    uint64_t                           queuedTasks;                 ///< Tasks waiting in the worker queues
+    uint64_t                           activeTasks;                 ///< Tasks currently executing
+    uint64_t                           parkedWorkers;               ///< Workers waiting for tasks
+    bool                               overloaded;                  ///< True while admission control rejects tasks
+    uint64_t                           rejectedTasks;               ///< Tasks rejected by TryEnqueue
+    uint64_t                           stolenTasks;                 ///< Tasks taken from another worker's queue
+    uint64_t                           unhandledExceptions;         ///< Exceptions passed to the error sink
+    uint64_t                           stuckTasks;                  ///< Tasks reported by the watchdog
+    int64_t                            lastSojournTime;             ///< Sojourn time of the most recently dequeued task in nanoseconds
+    uint64_t                           sojourn[SharedStatsBuckets]; ///< Sojourn time histogram
+    std::vector<SharedStatsWorkerData> workers;                     ///< Counters per worker
+};
+
+///
+/// \brief POSIX shared-memory segment (shm_open) holding a SharedStatsHeader and its workers
+///
+/// The writing process creates the segment and updates it under a seqlock:
+/// the sequence is odd while an update is written, so readers in other
+/// processes retry until they copied an update with the same even sequence
+/// before and after. Readers never write to the segment, so polling it causes
+/// no cache-line transfers back to the writer beyond the copy itself.
+///
+/// \note Only available on Linux (THREADPOOL_HAS_SHARED_STATS is defined).
+/// \note Thread safety: BeginUpdate / EndUpdate must be called by one writer at a time.
+///
+class SharedStatsSegment
+{
+public:
+    SharedStatsSegment() = default;
+
+    ///
+    /// \brief Unmaps the segment, and removes it if this instance created it
+    ///
+    ~SharedStatsSegment();
+
+    // Delete copy constructor and assignment operator
+    SharedStatsSegment(const SharedStatsSegment&)            = delete;
+    SharedStatsSegment& operator=(const SharedStatsSegment&) = delete;
+
+    ///
+    /// \brief Creates the segment, replacing a stale one of the same name
+    ///
+    /// \param name Name for shm_open, starting with a slash
+    /// \param workerCount Number of worker entries
+    /// \param interval Publishing interval recorded in the header (nanoseconds)
+    /// \return bool True on success
+    ///
+    bool Create(const std::string& name, const uint32_t workerCount, const int64_t interval);
+
+    ///
+    /// \brief Maps an existing segment read-only
+    ///
+    /// \param name Name for shm_open, starting with a slash
+    /// \return bool True if the segment exists and has a compatible layout
+    ///
+    bool Attach(const std::string& name);
+
+    ///
+    /// \brief Returns the header of the mapped segment
+    ///
+    SharedStatsHeader& Header() const;
+
+    ///
+    /// \brief Returns a worker entry of the mapped segment
+    ///
+    SharedStatsWorker& Worker(const size_t worker) const;
+
+    ///
+    /// \brief Returns the name of a segment created by this instance
+    ///
+    /// \return const std::string& Name passed to Create (empty for attached segments)
+    ///
+    const std::string& Name() const;
+
+    ///
+    /// \brief Marks the start of an update (the sequence becomes odd)
+    ///
+    void BeginUpdate();
+
+    ///
+    /// \brief Marks the end of an update (the sequence becomes even)
+    ///
+    void EndUpdate();
+
+    ///
+    /// \brief Copies a consistent update
+    ///
+    /// \param snapshot Receives the copy
+    /// \return bool True on success, false if no consistent copy was obtained after many retries or nothing was published yet
+    ///
+    bool Read(SharedStatsSnapshot& snapshot) const;
+
+    ///
+    /// \brief Lists the segments of this library in /dev/shm
+    ///
+    /// \return std::vector<std::string> Names for Attach (with a leading slash)
+    ///
+    static std::vector<std::string> List();
+
+    ///
+    /// \brief Prefix of the default segment names, "/threadpool."
+    ///
+    static constexpr const char* NamePrefix = "/threadpool.";
+
+private:
+    void*       mapping_ = nullptr; ///< Mapped segment (nullptr if none)
+    size_t      size_    = 0;       ///< Size of the mapping
+    std::string name_;              ///< Name to unlink (empty unless created by this instance)
+};
+
+#endif // __THREAD_POOL_SHARED_STATS_H_INCL__
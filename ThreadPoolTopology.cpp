@@ -0,0 +1,149 @@
+///
+/// \file ThreadPoolTopology.cpp
+/// \brief Implementation of the CpuTopology class
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolTopology.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#if defined(__linux__)
+#include <fstream>
+#include <sched.h>
+#endif
+
+namespace
+{
+#if defined(__linux__)
+///
+/// \brief Reads the first line of a sysfs attribute
+///
+/// \return std::string Contents of the first line, or an empty string if the file cannot be read
+///
+std::string ReadAttribute(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string   line;
+    std::getline(file, line);
+    return line;
+}
+
+///
+/// \brief Returns the key shared by all CPUs of the same domain as the given CPU
+///
+std::string DomainKey(const unsigned cpu, const CpuTopology::Level level)
+{
+    const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+
+    // CPUs with the same shared_cpu_list of their level 3 cache share that cache
+    if (CpuTopology::Level::Cache == level)
+    {
+        for (unsigned index = 0;; ++index)
+        {
+            const std::string cache      = base + "/cache/index" + std::to_string(index);
+            const std::string cacheLevel = ReadAttribute(cache + "/level");
+            if (cacheLevel.empty() == true)
+            {
+                break;
+            }
+
+            if ("3" == cacheLevel)
+            {
+                return "cache:" + ReadAttribute(cache + "/shared_cpu_list");
+            }
+        }
+    }
+
+    return "package:" + ReadAttribute(base + "/topology/physical_package_id");
+}
+#endif
+
+///
+/// \brief Returns a single domain with the given number of CPUs
+///
+std::vector<CpuTopology::Domain> SingleDomain(const unsigned cpuCount)
+{
+    CpuTopology::Domain domain;
+    for (unsigned cpu = 0; cpu < std::max(cpuCount, 1U); ++cpu)
+    {
+        domain.cpus.push_back(cpu);
+    }
+    return {std::move(domain)};
+}
+} // namespace
+
+CpuTopology::CpuTopology(std::vector<Domain> domains) : domains_(std::move(domains))
+{
+    if (domains_.empty() == true)
+    {
+        throw std::invalid_argument("topology requires at least one domain");
+    }
+
+    for (const Domain& domain : domains_)
+    {
+        if (domain.cpus.empty() == true)
+        {
+            throw std::invalid_argument("topology domain without CPUs");
+        }
+    }
+}
+
+CpuTopology CpuTopology::Detect(const Level level)
+{
+#if defined(__linux__)
+    // Only CPUs the process may run on, so that containers and taskset are respected
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (0 == sched_getaffinity(0, sizeof(allowed), &allowed))
+    {
+        std::vector<Domain>                     domains;
+        std::unordered_map<std::string, size_t> domainIndex;
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (0 == CPU_ISSET(cpu, &allowed))
+            {
+                continue;
+            }
+
+            // CPUs are visited in ascending order, so domains end up ordered by their first CPU
+            const auto [entry, inserted] = domainIndex.emplace(DomainKey(cpu, level), domains.size());
+            if (true == inserted)
+            {
+                domains.emplace_back();
+            }
+            domains[entry->second].cpus.push_back(cpu);
+        }
+
+        if (domains.empty() == false)
+        {
+            return CpuTopology(std::move(domains));
+        }
+    }
+#else
+    static_cast<void>(level);
+#endif
+
+    return CpuTopology(SingleDomain(std::thread::hardware_concurrency()));
+}
+
+const std::vector<CpuTopology::Domain>& CpuTopology::GetDomains() const
+{
+    return domains_;
+}
+
+size_t CpuTopology::GetCpuCount() const
+{
+    size_t count = 0;
+    for (const Domain& domain : domains_)
+    {
+        count += domain.cpus.size();
+    }
+    return count;
+}
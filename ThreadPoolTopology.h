@@ -0,0 +1,83 @@
+///
+/// \file ThreadPoolTopology.h
+/// \brief CPU topology used to build hierarchical thread pools
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_TOPOLOGY_H_INCL__
+#define __THREAD_POOL_TOPOLOGY_H_INCL__
+
+#include <cstddef>
+#include <vector>
+
+///
+/// \brief Partition of the usable CPUs into locality domains
+///
+/// A domain is a set of CPUs that share a last-level cache (e.g. an AMD CCX)
+/// or a package (socket). A ThreadPool constructed from a topology runs one
+/// worker per CPU, pins each worker to the CPUs of its domain and steals
+/// within a domain before it steals from a remote one.
+///
+/// \code
+/// ThreadPool pool(CpuTopology::Detect(CpuTopology::Level::Cache));
+/// \endcode
+///
+/// \note Thread safety: Immutable after construction.
+///
+class CpuTopology
+{
+public:
+    ///
+    /// \brief Granularity of the domains
+    ///
+    enum class Level
+    {
+        Cache,  ///< CPUs sharing the last-level (L3) cache
+        Package ///< CPUs of the same package (socket)
+    };
+
+    ///
+    /// \brief CPUs of one locality domain
+    ///
+    struct Domain
+    {
+        std::vector<unsigned> cpus; ///< CPU numbers, ascending
+    };
+
+    ///
+    /// \brief Builds a topology from explicitly given domains
+    ///
+    /// \param domains Domains to use, each with at least one CPU
+    /// \throws std::invalid_argument If there is no domain or a domain has no CPUs
+    ///
+    explicit CpuTopology(std::vector<Domain> domains);
+
+    ///
+    /// \brief Detects the domains of the CPUs the calling thread may run on
+    ///
+    /// On Linux, the domains are read from /sys/devices/system/cpu. CPUs without
+    /// cache information are grouped by package. Elsewhere, or if nothing can be
+    /// read, all CPUs form a single domain.
+    ///
+    /// \param level Granularity of the domains
+    /// \return CpuTopology Detected topology
+    ///
+    static CpuTopology Detect(const Level level = Level::Cache);
+
+    ///
+    /// \brief Returns the domains
+    ///
+    const std::vector<Domain>& GetDomains() const;
+
+    ///
+    /// \brief Returns the number of CPUs in all domains
+    ///
+    size_t GetCpuCount() const;
+
+private:
+    std::vector<Domain> domains_; ///< Domains ordered by their first CPU
+};
+
+#endif // __THREAD_POOL_TOPOLOGY_H_INCL__
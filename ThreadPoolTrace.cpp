@@ -0,0 +1,249 @@
+///
+/// \file ThreadPoolTrace.cpp
+/// \brief Implementation of the task trace writer and reader
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#include "ThreadPoolTrace.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+///
+/// \brief Interval at which the writer thread collects the worker buffers
+///
+constexpr std::chrono::milliseconds FlushInterval(10);
+
+constexpr char TraceMagic[8] = {'T', 'P', 'T', 'R', 'A', 'C', 'E', '\0'};
+} // namespace
+
+TraceWriter::TraceWriter(const size_t bufferCount) : file_(nullptr), recording_(false), firstId_(0), origin_(0), failed_(false), stop_(false)
+{
+    for (size_t i = 0; i < std::max<size_t>(bufferCount, 1); ++i)
+    {
+        buffers_.push_back(std::make_unique<Buffer>());
+    }
+}
+
+TraceWriter::~TraceWriter()
+{
+    Stop();
+}
+
+bool TraceWriter::Start(const std::string& path, const uint64_t firstId, const int64_t origin)
+{
+    if (nullptr != file_)
+    {
+        return false;
+    }
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (nullptr == file_)
+    {
+        return false;
+    }
+
+    // Events of an earlier recording that finished late are dropped by id
+    firstId_ = firstId;
+    origin_  = origin;
+    failed_  = false;
+    tagIds_.clear();
+
+    const TraceFileHeader header {{TraceMagic[0], TraceMagic[1], TraceMagic[2], TraceMagic[3], TraceMagic[4], TraceMagic[5], TraceMagic[6], TraceMagic[7]},
+        TraceVersion, 0};
+    Write(&header, sizeof(header));
+
+    stop_   = false;
+    thread_ = std::thread([this] { Run(); });
+    recording_.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+bool TraceWriter::Stop()
+{
+    if (nullptr == file_)
+    {
+        return true;
+    }
+
+    // Tasks still queued or running at the stop no longer add events
+    recording_.store(false, std::memory_order_relaxed);
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    condition_.notify_one();
+    thread_.join();
+
+    // The writer thread flushed the buffers one last time before it exited; an append
+    // that checked the flag just before the stop may have come later, so release the
+    // buffers under their locks
+    for (const std::unique_ptr<Buffer>& buffer : buffers_)
+    {
+        std::unique_lock<std::mutex> lock(buffer->mutex);
+        std::vector<TraceEvent>().swap(buffer->events);
+    }
+    const bool closed = (0 == std::fclose(file_));
+    file_             = nullptr;
+    return false == failed_ && true == closed;
+}
+
+void TraceWriter::Append(const size_t buffer, const TraceEvent& event)
+{
+    if (false == recording_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Checked again under the lock, so that no event slips in after Stop released the buffer
+    Buffer&                      target = *buffers_[buffer % buffers_.size()];
+    std::unique_lock<std::mutex> lock(target.mutex);
+    if (true == recording_.load(std::memory_order_relaxed))
+    {
+        target.events.push_back(event);
+    }
+}
+
+void TraceWriter::Run()
+{
+    std::vector<TraceEvent> pending;
+    for (;;)
+    {
+        bool stopping = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait_for(lock, FlushInterval, [this] { return stop_; });
+            stopping = stop_;
+        }
+
+        Flush(pending);
+        if (true == stopping)
+        {
+            return;
+        }
+    }
+}
+
+void TraceWriter::Flush(std::vector<TraceEvent>& pending)
+{
+    for (const std::unique_ptr<Buffer>& buffer : buffers_)
+    {
+        // Swapping keeps the capacity of both vectors, so steady-state appends do not allocate
+        pending.clear();
+        {
+            std::unique_lock<std::mutex> lock(buffer->mutex);
+            pending.swap(buffer->events);
+        }
+
+        for (const TraceEvent& event : pending)
+        {
+            if (event.id < firstId_)
+            {
+                continue;
+            }
+
+            const uint32_t        tag    = TagId(event.tag);
+            const uint32_t        kind   = TraceTaskEntry;
+            const TraceTaskRecord record = {event.id, (event.parent >= firstId_) ? event.parent : 0, event.arrival - origin_, event.start - origin_,
+                event.duration, tag, event.worker};
+            Write(&kind, sizeof(kind));
+            Write(&record, sizeof(record));
+        }
+    }
+    std::fflush(file_);
+}
+
+uint32_t TraceWriter::TagId(const char* tag)
+{
+    if (nullptr == tag)
+    {
+        return 0;
+    }
+
+    // Tags are interned by address, as they are static strings
+    const auto found = tagIds_.find(tag);
+    if (tagIds_.end() != found)
+    {
+        return found->second;
+    }
+
+    const uint32_t id     = static_cast<uint32_t>(tagIds_.size()) + 1;
+    const uint32_t kind   = TraceTagEntry;
+    const uint32_t length = static_cast<uint32_t>(std::strlen(tag));
+    Write(&kind, sizeof(kind));
+    Write(&id, sizeof(id));
+    Write(&length, sizeof(length));
+    Write(tag, length);
+    tagIds_.emplace(tag, id);
+    return id;
+}
+
+void TraceWriter::Write(const void* data, const size_t size)
+{
+    if (size != std::fwrite(data, 1, size, file_))
+    {
+        failed_ = true;
+    }
+}
+
+bool ReadTraceFile(const std::string& path, TraceFile& trace)
+{
+    trace.tags.assign(1, std::string());
+    trace.tasks.clear();
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if (nullptr == file)
+    {
+        return false;
+    }
+
+    TraceFileHeader header;
+    if (1 != std::fread(&header, sizeof(header), 1, file.get()) || 0 != std::memcmp(header.magic, TraceMagic, sizeof(TraceMagic)) ||
+        TraceVersion != header.version)
+    {
+        return false;
+    }
+
+    // A recording cut off by a crash ends in a partial entry, which is ignored
+    uint32_t kind = 0;
+    while (1 == std::fread(&kind, sizeof(kind), 1, file.get()))
+    {
+        if (TraceTaskEntry == kind)
+        {
+            TraceTaskRecord record;
+            if (1 != std::fread(&record, sizeof(record), 1, file.get()))
+            {
+                break;
+            }
+            trace.tasks.push_back(record);
+        }
+        else if (TraceTagEntry == kind)
+        {
+            uint32_t id     = 0;
+            uint32_t length = 0;
+            if (1 != std::fread(&id, sizeof(id), 1, file.get()) || 1 != std::fread(&length, sizeof(length), 1, file.get()))
+            {
+                break;
+            }
+
+            std::string name(length, '\0');
+            if (0 != length && 1 != std::fread(name.data(), length, 1, file.get()))
+            {
+                break;
+            }
+            if (trace.tags.size() <= id)
+            {
+                trace.tags.resize(id + 1);
+            }
+            trace.tags[id] = std::move(name);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
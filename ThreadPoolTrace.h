@@ -0,0 +1,206 @@
+///
+/// \file ThreadPoolTrace.h
+/// \brief Binary task trace: file format, background writer and reader
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __THREAD_POOL_TRACE_H_INCL__
+#define __THREAD_POOL_TRACE_H_INCL__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+///
+/// \brief Version of the trace file layout, incremented on every incompatible change
+///
+constexpr uint32_t TraceVersion = 1;
+
+///
+/// \brief First bytes of a trace file
+///
+/// A trace file starts with this header and continues with entries, each
+/// introduced by a TraceEntryKind. All values are in the byte order of the
+/// recording machine.
+///
+struct TraceFileHeader
+{
+    char     magic[8]; ///< "TPTRACE" followed by a zero byte
+    uint32_t version;  ///< TraceVersion of the writer
+    uint32_t reserved; ///< Zero
+};
+
+///
+/// \brief Kind of the entry that follows in a trace file
+///
+enum TraceEntryKind : uint32_t
+{
+    TraceTagEntry  = 1, ///< uint32_t tag id, uint32_t length, then the tag's characters (not terminated)
+    TraceTaskEntry = 2  ///< TraceTaskRecord
+};
+
+///
+/// \brief One executed task in a trace file
+///
+/// Times are in nanoseconds since the recording started. A tag is written as a
+/// TraceTagEntry before the first task that refers to it.
+///
+struct TraceTaskRecord
+{
+    uint64_t id;       ///< Task id, unique within the file (ids start at one)
+    uint64_t parent;   ///< Id of the task that submitted this one (zero if it was submitted by another thread)
+    int64_t  arrival;  ///< Time at which the task was submitted
+    int64_t  start;    ///< Time at which a worker started it
+    int64_t  duration; ///< Time it ran
+    uint32_t tag;      ///< Tag id (zero for tasks without a tag)
+    uint32_t worker;   ///< Index of the worker that ran it
+};
+
+///
+/// \brief Executed task as buffered before it is written
+///
+struct TraceEvent
+{
+    uint64_t    id;       ///< Task id
+    uint64_t    parent;   ///< Id of the submitting task (zero for none)
+    int64_t     arrival;  ///< steady_clock nanoseconds at which the task was submitted
+    int64_t     start;    ///< steady_clock nanoseconds at which it started
+    int64_t     duration; ///< Nanoseconds it ran
+    const char* tag;      ///< Tag of the task (may be nullptr)
+    uint32_t    worker;   ///< Index of the worker that ran it
+};
+
+///
+/// \brief Writes task events to a trace file from a background thread
+///
+/// Every worker appends to its own buffer, so recording costs an uncontended
+/// lock and a vector append per task. The writer thread swaps the buffers out
+/// every few milliseconds, assigns ids to new tags and writes the records with
+/// buffered stdio.
+///
+/// \note Thread safety: Append may be called concurrently with different buffer
+///       indices; Start and Stop must be serialized by the caller.
+///
+class TraceWriter
+{
+public:
+    ///
+    /// \brief Creates the writer with one buffer per worker
+    ///
+    /// \param bufferCount Number of buffers (at least one)
+    ///
+    explicit TraceWriter(const size_t bufferCount);
+
+    ///
+    /// \brief Stops a running recording
+    ///
+    ~TraceWriter();
+
+    // Delete copy constructor and assignment operator
+    TraceWriter(const TraceWriter&)            = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    ///
+    /// \brief Creates the trace file and starts the writer thread
+    ///
+    /// \param path File to create (truncated if it exists)
+    /// \param firstId Smallest task id of this recording; older events are dropped
+    /// \param origin steady_clock nanoseconds that become time zero in the file
+    /// \return bool True on success, false if the file cannot be created
+    ///
+    bool Start(const std::string& path, const uint64_t firstId, const int64_t origin);
+
+    ///
+    /// \brief Writes the remaining events, stops the writer thread and closes the file
+    ///
+    /// Events of tasks that finish after the stop are dropped, and the buffers
+    /// are released.
+    ///
+    /// \return bool True if every record was written, false on a write error
+    ///
+    bool Stop();
+
+    ///
+    /// \brief Buffers the event of an executed task
+    ///
+    /// The event is dropped while no recording is running.
+    ///
+    /// \param buffer Buffer of the calling worker
+    /// \param event Event to record
+    ///
+    void Append(const size_t buffer, const TraceEvent& event);
+
+private:
+    ///
+    /// \brief Events of one worker, on their own cache line
+    ///
+    struct alignas(64) Buffer
+    {
+        std::mutex              mutex;  ///< Protects events
+        std::vector<TraceEvent> events; ///< Events not yet written
+    };
+
+    std::vector<std::unique_ptr<Buffer>>      buffers_;   ///< One buffer per worker
+    std::FILE*                                file_;      ///< Trace file (nullptr while not recording)
+    std::atomic<bool>                         recording_; ///< True while Append buffers events
+    uint64_t                                  firstId_;   ///< Smallest task id of the recording
+    int64_t                                   origin_;    ///< Time zero of the recording
+    std::unordered_map<const char*, uint32_t> tagIds_;    ///< Ids of the tags written so far
+    bool                                      failed_;    ///< True once a write failed
+    std::thread                               thread_;    ///< Writer thread
+    std::mutex                                mutex_;     ///< Protects stop_
+    std::condition_variable                   condition_; ///< Wakes the writer thread to stop
+    bool                                      stop_;      ///< Flag telling the writer thread to exit
+
+    ///
+    /// \brief Loop of the writer thread
+    ///
+    void Run();
+
+    ///
+    /// \brief Writes the events buffered so far
+    ///
+    /// \param pending Scratch vector swapped with each buffer
+    ///
+    void Flush(std::vector<TraceEvent>& pending);
+
+    ///
+    /// \brief Returns the id of a tag, writing a tag entry on first use
+    ///
+    uint32_t TagId(const char* tag);
+
+    ///
+    /// \brief Writes raw bytes to the file
+    ///
+    void Write(const void* data, const size_t size);
+};
+
+///
+/// \brief Contents of a trace file
+///
+struct TraceFile
+{
+    std::vector<std::string>     tags;  ///< Tag names indexed by tag id (index zero is the empty name)
+    std::vector<TraceTaskRecord> tasks; ///< Task records in the order they were written
+};
+
+///
+/// \brief Reads a complete trace file
+///
+/// \param path File to read
+/// \param trace Receives the tags and task records
+/// \return bool True on success, false if the file cannot be read or is not a trace of this version
+///
+bool ReadTraceFile(const std::string& path, TraceFile& trace);
+
+#endif // __THREAD_POOL_TRACE_H_INCL__
@@ -0,0 +1,343 @@
+///
+/// \file TypedPool.h
+/// \brief Homogeneous worker pool processing values of one type with a fixed handler
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+
+#ifndef __TYPED_POOL_H_INCL__
+#define __TYPED_POOL_H_INCL__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+///
+/// \brief Worker pool for a single item type and a handler known at compile time
+///
+/// When most traffic is one kind of message, wrapping every item in a
+/// type-erased task is pure overhead. TypedPool stores items by value in a
+/// contiguous ring allocated once at construction and calls the handler
+/// directly: there is no type erasure, no future and no allocation per item.
+///
+/// Workers take up to maxBatchSize items per lock acquisition, move them into
+/// a contiguous per-worker batch and process them outside the lock. If the
+/// handler accepts a std::span<T>, it receives the whole batch at once;
+/// otherwise it is called with each item (as T&).
+///
+/// \tparam T Item type (must be move constructible)
+/// \tparam Handler Callable invoked with std::span<T> or T&
+///
+/// \note Exceptions thrown by the handler are caught and counted in
+///       Statistics::failedItems (for a batch handler, the whole batch counts).
+/// \note This class is not copyable or movable.
+/// \note Thread safety: All operations are thread-safe; the handler is called
+///       concurrently from all workers.
+///
+template<class T, class Handler> class TypedPool
+{
+public:
+    static_assert(std::is_move_constructible_v<T>, "TypedPool requires a move constructible item type");
+    static_assert(std::is_invocable_v<Handler&, std::span<T>> || std::is_invocable_v<Handler&, T&>, "Handler must accept std::span<T> or T&");
+
+    ///
+    /// \brief Item counters of a TypedPool
+    ///
+    struct Statistics
+    {
+        size_t   queuedItems;    ///< Items waiting in the ring
+        uint64_t processedItems; ///< Items handed to the handler
+        uint64_t failedItems;    ///< Items whose handler call threw
+        uint64_t batches;        ///< Batches taken from the ring
+    };
+
+    ///
+    /// \brief Constructs a typed pool and starts its workers
+    ///
+    /// \param threadCount Number of worker threads to create
+    /// \param capacity Number of items the ring holds (allocated up front)
+    /// \param handler Handler invoked for every item or batch
+    /// \param maxBatchSize Maximum number of items a worker takes at once
+    /// \throws std::invalid_argument If capacity or maxBatchSize is zero
+    /// \throws std::system_error If thread creation fails
+    ///
+    TypedPool(const size_t threadCount, const size_t capacity = 65'536, Handler handler = Handler(), const size_t maxBatchSize = 64);
+
+    ///
+    /// \brief Destructor - processes the remaining items and joins the workers
+    ///
+    ~TypedPool();
+
+    // Delete copy constructor and assignment operator
+    TypedPool(const TypedPool&)            = delete;
+    TypedPool& operator=(const TypedPool&) = delete;
+
+    ///
+    /// \brief Adds an item, blocking while the ring is full
+    ///
+    /// \param item Item to process
+    /// \throws std::runtime_error If the pool has been stopped
+    ///
+    void Enqueue(T item);
+
+    ///
+    /// \brief Adds an item without blocking
+    ///
+    /// \param item Item to process
+    /// \return bool True if the item was added, false if the ring was full or the pool was stopped
+    ///
+    bool TryEnqueue(T item);
+
+    ///
+    /// \brief Constructs an item in place without blocking
+    ///
+    /// \param args Constructor arguments of T
+    /// \return bool True if the item was added, false if the ring was full or the pool was stopped
+    ///
+    template<class... Args> bool TryEmplace(Args&&... args);
+
+    ///
+    /// \brief Blocks until every added item has been processed
+    ///
+    void WaitForAllItems();
+
+    ///
+    /// \brief Returns the item counters
+    ///
+    /// \return Statistics Snapshot of the counters
+    /// \note Thread safety: Acquires and releases the queueMutex_
+    ///
+    Statistics GetStatistics() const;
+
+private:
+    std::vector<std::thread> workers_;        ///< Collection of worker threads
+    Handler                  handler_;        ///< Handler shared by all workers
+    const size_t             capacity_;       ///< Number of slots in the ring
+    const size_t             maxBatchSize_;   ///< Maximum number of items per batch
+    T*                       slots_;          ///< Ring storage (uninitialized where no item lives)
+    size_t                   head_;           ///< Slot of the oldest item
+    size_t                   size_;           ///< Number of items in the ring
+    mutable std::mutex       queueMutex_;     ///< Mutex protecting the ring and counters
+    std::condition_variable  available_;      ///< Condition variable for item availability
+    std::condition_variable  notFull_;        ///< Condition variable for ring space
+    std::condition_variable  finished_;       ///< Condition variable for completion
+    size_t                   activeBatches_;  ///< Batches currently being processed
+    bool                     stop_;           ///< Flag indicating shutdown
+    uint64_t                 processedItems_; ///< Items handed to the handler
+    uint64_t                 failedItems_;    ///< Items whose handler call threw
+    uint64_t                 batches_;        ///< Batches taken from the ring
+
+    ///
+    /// \brief Main loop of a worker thread
+    ///
+    void RunWorker();
+
+    ///
+    /// \brief Constructs an item in the next free slot and wakes a worker
+    ///
+    /// \note Thread safety: The caller must hold the queueMutex_ and ensure the ring is not full
+    ///
+    template<class... Args> void Push(Args&&... args);
+
+    ///
+    /// \brief Invokes the handler on a batch
+    ///
+    /// \return uint64_t Number of items whose handler call threw
+    ///
+    uint64_t Process(std::span<T> batch);
+};
+
+template<class T, class Handler>
+TypedPool<T, Handler>::TypedPool(const size_t threadCount, const size_t capacity, Handler handler, const size_t maxBatchSize) :
+    handler_(std::move(handler)), capacity_(capacity), maxBatchSize_(maxBatchSize), slots_(nullptr), head_(0), size_(0), activeBatches_(0),
+    stop_(false), processedItems_(0), failedItems_(0), batches_(0)
+{
+    if (0 == capacity_ || 0 == maxBatchSize_)
+    {
+        throw std::invalid_argument("TypedPool requires a non-zero capacity and batch size");
+    }
+
+    // Raw storage: items are constructed on push and destroyed when taken
+    slots_ = std::allocator<T>().allocate(capacity_);
+
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        workers_.emplace_back([this] { RunWorker(); });
+    }
+}
+
+template<class T, class Handler> TypedPool<T, Handler>::~TypedPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        stop_ = true;
+    }
+
+    available_.notify_all();
+    notFull_.notify_all();
+
+    for (std::thread& worker : workers_)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+
+    // Without workers, items left in the ring are destroyed unprocessed
+    for (; 0 < size_; size_--)
+    {
+        std::destroy_at(&slots_[head_]);
+        head_ = (head_ + 1) % capacity_;
+    }
+
+    std::allocator<T>().deallocate(slots_, capacity_);
+}
+
+template<class T, class Handler> void TypedPool<T, Handler>::Enqueue(T item)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    notFull_.wait(lock, [this] { return stop_ || size_ < capacity_; });
+
+    if (true == stop_)
+    {
+        throw std::runtime_error("enqueue on stopped TypedPool");
+    }
+
+    Push(std::move(item));
+}
+
+template<class T, class Handler> bool TypedPool<T, Handler>::TryEnqueue(T item)
+{
+    return TryEmplace(std::move(item));
+}
+
+template<class T, class Handler> template<class... Args> bool TypedPool<T, Handler>::TryEmplace(Args&&... args)
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+
+    if (true == stop_ || size_ == capacity_)
+    {
+        return false;
+    }
+
+    Push(std::forward<Args>(args)...);
+    return true;
+}
+
+template<class T, class Handler> void TypedPool<T, Handler>::WaitForAllItems()
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    finished_.wait(lock, [this] { return 0 == size_ && 0 == activeBatches_; });
+}
+
+template<class T, class Handler> typename TypedPool<T, Handler>::Statistics TypedPool<T, Handler>::GetStatistics() const
+{
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    return Statistics {size_, processedItems_, failedItems_, batches_};
+}
+
+template<class T, class Handler> void TypedPool<T, Handler>::RunWorker()
+{
+    // Per-worker batch buffer, reused for every batch so that processing never allocates
+    std::vector<T> batch;
+    batch.reserve(maxBatchSize_);
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            available_.wait(lock, [this] { return stop_ || 0 < size_; });
+
+            // Exit once the pool is stopping and the ring has been drained
+            if (true == stop_ && 0 == size_)
+            {
+                return;
+            }
+
+            // Take a fair share of the ring so that a burst is spread over all workers
+            const size_t share = std::max<size_t>(1, size_ / std::max<size_t>(1, workers_.size()));
+            const size_t count = std::min({size_, maxBatchSize_, share});
+            for (size_t i = 0; i < count; ++i)
+            {
+                batch.push_back(std::move(slots_[head_]));
+                std::destroy_at(&slots_[head_]);
+                head_ = (head_ + 1) % capacity_;
+            }
+            size_ -= count;
+            activeBatches_++;
+            batches_++;
+
+            // Leftover items for the next idle worker
+            if (0 < size_)
+            {
+                available_.notify_one();
+            }
+        }
+
+        notFull_.notify_all();
+
+        const size_t   count  = batch.size();
+        const uint64_t failed = Process(std::span<T>(batch));
+        batch.clear();
+
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        processedItems_ += count;
+        failedItems_ += failed;
+        activeBatches_--;
+        if (0 == size_ && 0 == activeBatches_)
+        {
+            finished_.notify_all();
+        }
+    }
+}
+
+template<class T, class Handler> template<class... Args> void TypedPool<T, Handler>::Push(Args&&... args)
+{
+    std::construct_at(&slots_[(head_ + size_) % capacity_], std::forward<Args>(args)...);
+    size_++;
+    available_.notify_one();
+}
+
+template<class T, class Handler> uint64_t TypedPool<T, Handler>::Process(std::span<T> batch)
+{
+    if constexpr (std::is_invocable_v<Handler&, std::span<T>>)
+    {
+        try
+        {
+            handler_(batch);
+            return 0;
+        }
+        catch (...)
+        {
+            return batch.size();
+        }
+    }
+    else
+    {
+        uint64_t failed = 0;
+        for (T& item : batch)
+        {
+            try
+            {
+                handler_(item);
+            }
+            catch (...)
+            {
+                failed++;
+            }
+        }
+        return failed;
+    }
+}
+
+#endif // __TYPED_POOL_H_INCL__
@@ -0,0 +1,32 @@
+///
+/// \file BasicThreadPoolPolicies.cpp
+/// \brief Compile check of BasicThreadPool for every combination of the provided policies
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// BasicThreadPool is header-only, so a policy combination is only compiled
+/// where it is used. Instantiating the class and its submission methods for
+/// every combination here catches one that does not compile before a user
+/// does. The object library is built with the benchmarks and never linked.
+///
+
+#include "BasicThreadPool.h"
+
+#define THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL(Queue, Idle, Task, Metrics)                                                          \
+    template class BasicThreadPool<Queue, Idle, Task, Metrics>;                                                                       \
+    template auto BasicThreadPool<Queue, Idle, Task, Metrics>::Enqueue<int (*)(int), int>(int (*&&)(int), int&&) -> std::future<int>; \
+    template bool BasicThreadPool<Queue, Idle, Task, Metrics>::TryEnqueue<void (*)()>(void (*&&)())
+
+#define THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_METRICS(Queue, Idle, Task)       \
+    THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL(Queue, Idle, Task, NoMetricsPolicy); \
+    THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL(Queue, Idle, Task, CountingMetricsPolicy)
+
+#define THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_TASKS(Queue, Idle)                    \
+    THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_METRICS(Queue, Idle, FunctionTaskPolicy); \
+    THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_METRICS(Queue, Idle, MoveOnlyTaskPolicy)
+
+THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_TASKS(FifoQueuePolicy, BlockingIdlePolicy);
+THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_TASKS(FifoQueuePolicy, SpinningIdlePolicy<>);
+THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_TASKS(RingQueuePolicy<4096>, BlockingIdlePolicy);
+THREADPOOL_INSTANTIATE_BASIC_THREAD_POOL_TASKS(RingQueuePolicy<4096>, SpinningIdlePolicy<>);
@@ -0,0 +1,165 @@
+///
+/// \file HugePageBenchmark.cpp
+/// \brief Throughput and dTLB misses with and without huge-page-backed task storage
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// Usage: HugePageBenchmark [tasks] [threads]
+///
+/// Fills a pool with millions of queued tasks before the workers may start,
+/// then drains it. Each configuration runs in the same process, with the data
+/// TLB read misses of all threads counted by perf_event_open. Counting needs
+/// kernel.perf_event_paranoid <= 2; otherwise the miss column shows n/a.
+///
+
+#include "ThreadPool.h"
+#include "ThreadPoolHugePages.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <latch>
+#include <linux/perf_event.h>
+#include <memory_resource>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+///
+/// \brief Counts data TLB read misses of the calling thread and threads it creates
+///
+class TlbMissCounter
+{
+public:
+    TlbMissCounter() : fd_(-1)
+    {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size           = sizeof(attributes);
+        attributes.type           = PERF_TYPE_HW_CACHE;
+        attributes.config         = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.disabled       = 1;
+        attributes.inherit        = 1; // Include the pool's workers, which are created after the counter
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv     = 1;
+
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+        if (fd_ >= 0)
+        {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    ~TlbMissCounter()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    ///
+    /// \brief Stops counting and returns the misses, or -1 if counting is unavailable
+    ///
+    int64_t Stop()
+    {
+        if (fd_ < 0)
+        {
+            return -1;
+        }
+
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t misses = 0;
+        if (sizeof(misses) != read(fd_, &misses, sizeof(misses)))
+        {
+            return -1;
+        }
+
+        return static_cast<int64_t>(misses);
+    }
+
+private:
+    int fd_;
+};
+
+///
+/// \brief Queues taskCount tasks while the workers are held back, then drains the pool
+///
+void Run(const char* name, const size_t taskCount, const size_t threadCount, std::pmr::memory_resource* resource, const HugePageMemoryResource* hugePages)
+{
+    TlbMissCounter counter;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        ThreadPool          pool(threadCount, taskCount + threadCount, resource);
+        std::latch          gate(1);
+        std::atomic<size_t> sum(0);
+
+        // Park every worker so that the whole backlog is in flight at once
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            pool.TryEnqueue([&gate] { gate.wait(); });
+        }
+
+        for (size_t i = 0; i < taskCount; ++i)
+        {
+            pool.TryEnqueue([&sum, i] { sum.fetch_add(i, std::memory_order_relaxed); });
+        }
+
+        // Report which page types the kernel granted while the whole backlog is mapped
+        if (nullptr != hugePages)
+        {
+            const HugePageMemoryResource::Statistics statistics = hugePages->GetStatistics();
+            std::printf(
+                "%-12s mapped %zu MiB MAP_HUGETLB, %zu MiB THP, %zu MiB normal\n", name, statistics.hugeTlbBytes >> 20,
+                statistics.transparentHugePageBytes >> 20, statistics.normalPageBytes >> 20);
+        }
+
+        gate.count_down();
+        pool.WaitForAllTasks();
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const int64_t                       misses  = counter.Stop();
+
+    std::printf("%-12s %10.2f Mtasks/s", name, static_cast<double>(taskCount) / elapsed.count() / 1e6);
+    if (misses >= 0)
+    {
+        std::printf(" %14lld dTLB misses\n", static_cast<long long>(misses));
+    }
+    else
+    {
+        std::printf(" %14s dTLB misses\n", "n/a");
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const size_t taskCount   = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 4'000'000;
+    const size_t threadCount = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+    std::printf("%zu tasks, %zu threads\n", taskCount, threadCount);
+
+    // Regular pages: recycling resource with default slabs on operator new
+    {
+        TaskMemoryResource normalPages;
+        Run("normal", taskCount, threadCount, &normalPages, nullptr);
+    }
+
+    // Huge pages: queue blocks and task nodes carved from 2 MiB slabs
+    {
+        HugePageMemoryResource hugePages;
+        TaskMemoryResource     taskMemory(&hugePages, HugePageMemoryResource::HugePageSize);
+        Run("huge pages", taskCount, threadCount, &taskMemory, &hugePages);
+    }
+
+    return EXIT_SUCCESS;
+}
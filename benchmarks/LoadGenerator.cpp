@@ -0,0 +1,298 @@
+///
+/// \file LoadGenerator.cpp
+/// \brief Open-loop load generator reporting latency free of coordinated omission
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// Usage: LoadGenerator [threads,...] [service us] [seconds per step] [fixed|poisson] [producers]
+///
+/// Producer threads submit tasks on a fixed schedule, at a constant or
+/// exponentially distributed interval, whether or not the pool keeps up. Each
+/// task's latency is measured from its intended submission time to its
+/// completion, so time spent blocked in Enqueue or waiting in a queue is
+/// counted even when the producer falls behind its schedule (a closed-loop
+/// driver would silently skip it). For every pool size the offered load is
+/// swept from 10% to 110% of the nominal capacity (threads / service time),
+/// printing one throughput/latency line per step.
+///
+
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+///
+/// \brief High dynamic range histogram of nanosecond values
+///
+/// Values below 2^SubBucketBits are counted exactly; above, every power of two
+/// is split into 2^(SubBucketBits - 1) buckets, so a recorded value is off by
+/// less than 1 / 2^(SubBucketBits - 1) (0.8%) over the full 64-bit range.
+///
+class Histogram
+{
+public:
+    Histogram() : counts_(SubBucketCount + (64 - SubBucketBits) * HalfCount, 0), total_(0), max_(0)
+    {
+    }
+
+    void Record(const uint64_t value)
+    {
+        ++counts_[Index(value)];
+        ++total_;
+        max_ = std::max(max_, value);
+    }
+
+    void Add(const Histogram& other)
+    {
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t Count() const
+    {
+        return total_;
+    }
+
+    uint64_t Max() const
+    {
+        return max_;
+    }
+
+    ///
+    /// \brief Returns the highest value equivalent to the given percentile
+    ///
+    uint64_t Percentile(const double percentile) const
+    {
+        const uint64_t rank       = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total_) + 0.5));
+        uint64_t       cumulative = 0;
+        for (size_t i = 0; i < counts_.size(); ++i)
+        {
+            cumulative += counts_[i];
+            if (cumulative >= rank)
+            {
+                return std::min(HighestEquivalent(i), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static constexpr unsigned SubBucketBits  = 8;
+    static constexpr size_t   SubBucketCount = size_t(1) << SubBucketBits;
+    static constexpr size_t   HalfCount      = SubBucketCount / 2;
+
+    std::vector<uint64_t> counts_; ///< Count per bucket
+    uint64_t              total_;  ///< Number of recorded values
+    uint64_t              max_;    ///< Largest recorded value
+
+    static size_t Index(const uint64_t value)
+    {
+        const unsigned width = static_cast<unsigned>(std::bit_width(value));
+        if (width <= SubBucketBits)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        // The top SubBucketBits bits select the bucket within the power of two
+        const unsigned shift = width - SubBucketBits;
+        return SubBucketCount + (shift - 1) * HalfCount + static_cast<size_t>((value >> shift) - HalfCount);
+    }
+
+    static uint64_t HighestEquivalent(const size_t index)
+    {
+        if (index < SubBucketCount)
+        {
+            return index;
+        }
+
+        const unsigned shift = static_cast<unsigned>((index - SubBucketCount) / HalfCount) + 1;
+        const uint64_t top   = (index - SubBucketCount) % HalfCount + HalfCount;
+        return ((top + 1) << shift) - 1;
+    }
+};
+
+///
+/// \brief Histograms of the worker threads of one load step
+///
+/// Every worker records into its own histogram, so that measuring does not
+/// add contention; they are merged once the step's pool has been destroyed.
+///
+struct Recorder
+{
+    std::mutex                              mutex;      ///< Protects histograms
+    std::vector<std::unique_ptr<Histogram>> histograms; ///< One histogram per thread that recorded
+};
+
+thread_local Histogram* threadHistogram = nullptr;
+
+void RecordLatency(Recorder& recorder, const uint64_t latency)
+{
+    if (nullptr == threadHistogram)
+    {
+        std::unique_lock<std::mutex> lock(recorder.mutex);
+        threadHistogram = recorder.histograms.emplace_back(std::make_unique<Histogram>()).get();
+    }
+    threadHistogram->Record(latency);
+}
+
+///
+/// \brief Keeps the worker busy for the given time, standing in for real work
+///
+void Spin(const std::chrono::nanoseconds serviceTime)
+{
+    const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + serviceTime;
+    while (std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+///
+/// \brief Waits for a point in time, sleeping while it is far away
+///
+void WaitUntil(const std::chrono::steady_clock::time_point deadline)
+{
+    for (std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now(); now < deadline; now = std::chrono::steady_clock::now())
+    {
+        if (deadline - now > std::chrono::microseconds(200))
+        {
+            std::this_thread::sleep_until(deadline - std::chrono::microseconds(100));
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+struct StepResult
+{
+    double    throughput; ///< Completed tasks per second, up to the last completion
+    Histogram latency;    ///< Intended start to completion, in nanoseconds
+};
+
+///
+/// \brief Offers a constant rate to a fresh pool for the given duration
+///
+StepResult RunStep(const size_t threadCount, const std::chrono::nanoseconds serviceTime, const std::chrono::nanoseconds duration, const bool poisson,
+    const size_t producerCount, const double rate)
+{
+    Recorder                                    recorder;
+    std::atomic<int64_t>                        lastCompletion(0);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+    const std::chrono::steady_clock::time_point end   = start + duration;
+    {
+        ThreadPool pool(threadCount);
+
+        // Every producer offers an equal share of the rate on its own schedule
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p < producerCount; ++p)
+        {
+            producers.emplace_back([&, p] {
+                std::mt19937_64                 random(0x9e3779b97f4a7c15ULL * (p + 1));
+                std::exponential_distribution<> exponential(1.0);
+                const double                    interval = 1e9 * static_cast<double>(producerCount) / rate;
+                double                          offset   = interval * static_cast<double>(p) / static_cast<double>(producerCount);
+                for (;;)
+                {
+                    // The schedule never slips: a producer that is late submits at once
+                    const std::chrono::steady_clock::time_point intended =
+                        start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::nano>(offset));
+                    if (intended >= end)
+                    {
+                        break;
+                    }
+                    WaitUntil(intended);
+
+                    pool.Enqueue([&recorder, &lastCompletion, intended, serviceTime] {
+                        Spin(serviceTime);
+                        const std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+                        RecordLatency(recorder, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(done - intended).count()));
+                        const int64_t doneTime = done.time_since_epoch().count();
+                        int64_t       last     = lastCompletion.load(std::memory_order_relaxed);
+                        while (doneTime > last && false == lastCompletion.compare_exchange_weak(last, doneTime, std::memory_order_relaxed))
+                        {
+                        }
+                    });
+                    offset += (true == poisson) ? interval * exponential(random) : interval;
+                }
+            });
+        }
+
+        for (std::thread& producer : producers)
+        {
+            producer.join();
+        }
+        pool.WaitForAllTasks();
+    }
+
+    StepResult result {0.0, Histogram()};
+    for (const std::unique_ptr<Histogram>& histogram : recorder.histograms)
+    {
+        result.latency.Add(*histogram);
+    }
+
+    const std::chrono::steady_clock::time_point last {std::chrono::steady_clock::duration(lastCompletion.load())};
+    const std::chrono::duration<double>         busy = std::max(last, end) - start;
+    result.throughput                                = static_cast<double>(result.latency.Count()) / busy.count();
+    return result;
+}
+
+std::vector<size_t> ParseList(const char* text)
+{
+    std::vector<size_t> values;
+    for (const char* cursor = text; '\0' != *cursor;)
+    {
+        char* next = nullptr;
+        values.push_back(std::strtoull(cursor, &next, 10));
+        cursor = ('\0' != *next) ? next + 1 : next;
+    }
+    return values;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const std::vector<size_t> threadCounts = (argc > 1) ? ParseList(argv[1]) : std::vector<size_t> {std::max(1U, std::thread::hardware_concurrency() / 2)};
+    const std::chrono::nanoseconds serviceTime(static_cast<int64_t>(1000.0 * ((argc > 2) ? std::strtod(argv[2], nullptr) : 20.0)));
+    const std::chrono::nanoseconds duration(static_cast<int64_t>(1e9 * ((argc > 3) ? std::strtod(argv[3], nullptr) : 2.0)));
+    const bool                     poisson       = (argc > 4) ? (0 == std::strcmp(argv[4], "poisson")) : true;
+    const size_t                   producerCount = (argc > 5) ? std::max<size_t>(1, std::strtoull(argv[5], nullptr, 10)) : 2;
+
+    const double loads[] = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.85, 0.9, 0.95, 1.0, 1.05, 1.1};
+
+    std::printf("service %.1f us, %.1f s per step, %s arrivals, %zu producers\n", static_cast<double>(serviceTime.count()) / 1e3,
+        static_cast<double>(duration.count()) / 1e9, (true == poisson) ? "poisson" : "fixed", producerCount);
+    for (const size_t threadCount : threadCounts)
+    {
+        const double capacity = static_cast<double>(threadCount) * 1e9 / static_cast<double>(serviceTime.count());
+        std::printf("\n%zu threads, nominal capacity %.0f tasks/s\n", threadCount, capacity);
+        std::printf("%6s %12s %12s %10s %10s %10s %10s %10s\n", "load", "offered/s", "achieved/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+        for (const double load : loads)
+        {
+            const double     rate   = load * capacity;
+            const StepResult result = RunStep(threadCount, serviceTime, duration, poisson, producerCount, rate);
+            const auto       micros = [&](const double percentile) { return static_cast<double>(result.latency.Percentile(percentile)) / 1e3; };
+            std::printf("%5.0f%% %12.0f %12.0f %10.1f %10.1f %10.1f %10.1f %10.1f\n", load * 100.0, rate, result.throughput, micros(50.0), micros(90.0),
+                micros(99.0), micros(99.9), static_cast<double>(result.latency.Max()) / 1e3);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
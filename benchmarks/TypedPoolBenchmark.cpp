@@ -0,0 +1,97 @@
+///
+/// \file TypedPoolBenchmark.cpp
+/// \brief Message throughput of TypedPool compared to ThreadPool::TryEnqueue
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// Usage: TypedPoolBenchmark [messages] [threads]
+///
+/// Processes the same stream of small Request messages once as type-erased
+/// ThreadPool tasks and once through a TypedPool with a batch handler.
+///
+
+#include "ThreadPool.h"
+#include "TypedPool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <thread>
+
+namespace
+{
+struct Request
+{
+    uint64_t id;
+    uint64_t payload[3];
+};
+
+std::atomic<uint64_t> checksum(0);
+
+void Handle(const Request& request)
+{
+    checksum.fetch_add(request.id + request.payload[0], std::memory_order_relaxed);
+}
+
+struct BatchHandler
+{
+    void operator()(std::span<Request> batch) const
+    {
+        uint64_t sum = 0;
+        for (const Request& request : batch)
+        {
+            sum += request.id + request.payload[0];
+        }
+        checksum.fetch_add(sum, std::memory_order_relaxed);
+    }
+};
+
+void Report(const char* name, const size_t messageCount, const std::chrono::steady_clock::time_point start)
+{
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("%-12s %10.2f Mmsg/s (checksum %llu)\n", name, static_cast<double>(messageCount) / elapsed.count() / 1e6,
+        static_cast<unsigned long long>(checksum.exchange(0)));
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    const size_t messageCount = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 4'000'000;
+    const size_t threadCount  = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+
+    std::printf("%zu messages, %zu threads\n", messageCount, threadCount);
+
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        {
+            ThreadPool pool(threadCount, 65'536);
+            for (uint64_t i = 0; i < messageCount; ++i)
+            {
+                while (false == pool.TryEnqueue(Handle, Request {i, {i, 0, 0}}))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            pool.WaitForAllTasks();
+        }
+        Report("ThreadPool", messageCount, start);
+    }
+
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        {
+            TypedPool<Request, BatchHandler> pool(threadCount, 65'536);
+            for (uint64_t i = 0; i < messageCount; ++i)
+            {
+                pool.Enqueue(Request {i, {i, 0, 0}});
+            }
+            pool.WaitForAllItems();
+        }
+        Report("TypedPool", messageCount, start);
+    }
+
+    return EXIT_SUCCESS;
+}
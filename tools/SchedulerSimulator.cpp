@@ -0,0 +1,502 @@
+///
+/// \file SchedulerSimulator.cpp
+/// \brief Deterministic discrete-event simulation of the pool's scheduling policies
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// Usage: SchedulerSimulator [key=value ...]
+///
+/// Every key accepts a comma-separated list; the simulator runs every
+/// combination and prints one line per configuration:
+///
+///   workers=4           Number of workers
+///   policy=global       global (one FIFO queue, as GetNextTask without stealing),
+///                       stealing (per-worker queues with stealing, as ThreadPool),
+///                       priority (global queue, high-priority tasks first),
+///                       batch (global queue, up to batch tasks per lock acquisition)
+///   idle=blocking       blocking (parked workers pay the wake-up cost) or spinning
+///                       (idle workers burn CPU but pick up work at once)
+///   load=0.5,0.8,0.9    Offered load as a fraction of workers / mean duration
+///   arrivals=poisson    poisson or fixed inter-arrival times
+///   dist=exp            fixed, exp, lognormal (sigma 1) or bimodal (5% of tasks 10x longer)
+///   mean=50             Mean task duration in microseconds
+///   lock=0.1            Critical section of one queue operation in microseconds
+///   wake=5              Latency of waking a parked worker in microseconds
+///   spin=0.2            Latency of a spinning worker noticing work in microseconds
+///   steal=0.3           Cost of probing one victim queue in microseconds
+///   batch=8             Tasks taken per lock acquisition by the batch policy
+///   high=0.1            Fraction of high-priority tasks (priority policy)
+///   tasks=200000        Tasks per run
+///   seed=1              Random seed; with the same standard library, equal seeds give identical results
+///
+/// The model is deliberately simple: queue locks serialize their critical
+/// sections, a worker that finds nothing parks (or spins) until an arrival
+/// wakes it, and thieves probe victims in random order. Latency is measured
+/// from arrival to completion in simulated time; CPU is the time workers
+/// spent running tasks, in queue critical sections, probing victims and
+/// spinning.
+///
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+enum class Policy
+{
+    Global,
+    Stealing,
+    Priority,
+    Batch
+};
+
+enum class Distribution
+{
+    Fixed,
+    Exponential,
+    Lognormal,
+    Bimodal
+};
+
+struct Config
+{
+    size_t       workers;      ///< Number of workers
+    Policy       policy;       ///< Queueing policy
+    bool         spinning;     ///< True if idle workers spin instead of parking
+    double       load;         ///< Offered load as a fraction of the capacity
+    bool         poisson;      ///< True for exponential inter-arrival times
+    Distribution distribution; ///< Task duration distribution
+    double       mean;         ///< Mean task duration (us)
+    double       lockCost;     ///< Critical section of a queue operation (us)
+    double       wakeCost;     ///< Latency of waking a parked worker (us)
+    double       spinCost;     ///< Latency of a spinning worker noticing work (us)
+    double       stealCost;    ///< Cost of probing one victim (us)
+    size_t       batch;        ///< Tasks per lock acquisition of the batch policy
+    double       high;         ///< Fraction of high-priority tasks
+    size_t       tasks;        ///< Tasks per run
+    uint64_t     seed;         ///< Random seed
+};
+
+struct Result
+{
+    double throughput; ///< Completed tasks per simulated second
+    double p50;        ///< Median latency (ms)
+    double p99;        ///< 99th percentile latency (ms)
+    double p999;       ///< 99.9th percentile latency (ms)
+    double highP99;    ///< 99th percentile latency of high-priority tasks (ms, zero if there are none)
+    double cpu;        ///< CPU time of the workers (ms)
+    double useful;     ///< Fraction of the CPU time spent running tasks
+};
+
+struct SimulatedTask
+{
+    double arrival;  ///< Arrival time (us)
+    double duration; ///< Run time (us)
+    bool   high;     ///< True for a high-priority task
+};
+
+///
+/// \brief Event-driven model of one pool configuration
+///
+class Simulator
+{
+public:
+    explicit Simulator(const Config& config) :
+        config_(config), random_(config.seed), queues_((Policy::Stealing == config.policy) ? config.workers : 1),
+        lockFree_(queues_.size(), 0.0), idle_(config.workers, false), idleSince_(config.workers, 0.0), arrived_(0), nextQueue_(0), sequence_(0),
+        busy_(0.0), overhead_(0.0), spin_(0.0), end_(0.0)
+    {
+    }
+
+    Result Run()
+    {
+        // All workers start idle; the first arrival wakes one
+        for (size_t worker = 0; worker < config_.workers; ++worker)
+        {
+            Park(worker, 0.0);
+        }
+        Schedule(0.0, Arrival, 0);
+
+        while (events_.empty() == false)
+        {
+            const Event event = events_.top();
+            events_.pop();
+            if (Arrival == event.kind)
+            {
+                Arrive(event.time);
+            }
+            else
+            {
+                FindWork(event.worker, event.time);
+            }
+        }
+
+        // Spinning workers burned CPU until the end of the run
+        for (size_t worker = 0; worker < config_.workers; ++worker)
+        {
+            if (true == idle_[worker] && true == config_.spinning)
+            {
+                spin_ += end_ - idleSince_[worker];
+            }
+        }
+
+        Result result {};
+        result.throughput = static_cast<double>(latencies_.size()) / (end_ / 1e6);
+        result.p50        = Percentile(latencies_, 50.0);
+        result.p99        = Percentile(latencies_, 99.0);
+        result.p999       = Percentile(latencies_, 99.9);
+        result.highP99    = Percentile(highLatencies_, 99.0);
+        result.cpu        = (busy_ + overhead_ + spin_) / 1e3;
+        result.useful     = busy_ / (busy_ + overhead_ + spin_);
+        return result;
+    }
+
+private:
+    enum Kind
+    {
+        Arrival,
+        WorkerFree
+    };
+
+    struct Event
+    {
+        double   time;     ///< Simulated time (us)
+        uint64_t sequence; ///< Tie breaker keeping the order deterministic
+        Kind     kind;     ///< Event type
+        size_t   worker;   ///< Worker of a WorkerFree event
+
+        bool operator>(const Event& other) const
+        {
+            return (time != other.time) ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    const Config                                                        config_;        ///< Simulated configuration
+    std::mt19937_64                                                     random_;        ///< Source of arrivals, durations and victims
+    std::vector<std::deque<SimulatedTask>>                              queues_;        ///< One global queue, or one per worker
+    std::deque<SimulatedTask>                                           highQueue_;     ///< High-priority tasks of the priority policy
+    std::vector<double>                                                 lockFree_;      ///< Time each queue lock becomes free
+    std::vector<bool>                                                   idle_;          ///< True while a worker is parked or spinning
+    std::vector<double>                                                 idleSince_;     ///< Time each idle worker went idle
+    std::deque<size_t>                                                  idleWorkers_;   ///< Idle workers, in the order they went idle
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;        ///< Pending events
+    std::vector<double>                                                 latencies_;     ///< Latency of every completed task (us)
+    std::vector<double>                                                 highLatencies_; ///< Latency of every high-priority task (us)
+    size_t                                                              arrived_;       ///< Tasks that arrived so far
+    size_t                                                              nextQueue_;     ///< Round-robin cursor for arrivals when no worker is idle
+    uint64_t                                                            sequence_;      ///< Sequence number of the next event
+    double                                                              busy_;          ///< Time spent running tasks (us)
+    double                                                              overhead_;      ///< Time spent in queue operations and steal probes (us)
+    double                                                              spin_;          ///< Time spent spinning while idle (us)
+    double                                                              end_;           ///< Time of the last completion (us)
+
+    void Schedule(const double time, const Kind kind, const size_t worker)
+    {
+        events_.push(Event {time, sequence_++, kind, worker});
+    }
+
+    ///
+    /// \brief Enters a queue's critical section, returning the time it is left
+    ///
+    double Lock(const size_t queue, const double time)
+    {
+        const double start = std::max(time, lockFree_[queue]);
+        lockFree_[queue]   = start + config_.lockCost;
+        overhead_ += config_.lockCost;
+        return lockFree_[queue];
+    }
+
+    double NextDuration()
+    {
+        switch (config_.distribution)
+        {
+        case Distribution::Fixed:
+            return config_.mean;
+        case Distribution::Exponential:
+            return std::exponential_distribution<>(1.0 / config_.mean)(random_);
+        case Distribution::Lognormal:
+            // sigma 1; mu chosen so that the mean stays config_.mean
+            return std::lognormal_distribution<>(std::log(config_.mean) - 0.5, 1.0)(random_);
+        case Distribution::Bimodal:
+        {
+            const double shortTask = config_.mean / (0.95 + 0.05 * 10.0);
+            return (std::uniform_real_distribution<>(0.0, 1.0)(random_) < 0.05) ? 10.0 * shortTask : shortTask;
+        }
+        }
+        return config_.mean;
+    }
+
+    void Arrive(const double time)
+    {
+        const SimulatedTask task {time, NextDuration(), std::uniform_real_distribution<>(0.0, 1.0)(random_) < config_.high};
+        if (++arrived_ < config_.tasks)
+        {
+            const double interval = config_.mean / (config_.load * static_cast<double>(config_.workers));
+            Schedule(time + ((true == config_.poisson) ? std::exponential_distribution<>(1.0 / interval)(random_) : interval), Arrival, 0);
+        }
+
+        // Like ThreadPool, an external submitter prefers the queue of an idle worker
+        size_t queue = 0;
+        if (Policy::Stealing == config_.policy)
+        {
+            queue = (idleWorkers_.empty() == false) ? idleWorkers_.front() : nextQueue_++ % queues_.size();
+        }
+
+        const double visible = Lock(queue, time);
+        if (Policy::Priority == config_.policy && true == task.high)
+        {
+            highQueue_.push_back(task);
+        }
+        else
+        {
+            queues_[queue].push_back(task);
+        }
+
+        if (idleWorkers_.empty() == false)
+        {
+            const size_t worker = (Policy::Stealing == config_.policy && true == idle_[queue]) ? queue : idleWorkers_.front();
+            Wake(worker, visible);
+        }
+    }
+
+    void FindWork(const size_t worker, const double time)
+    {
+        if (Policy::Stealing != config_.policy)
+        {
+            const double left = Lock(0, time);
+            if (queues_[0].empty() == true && highQueue_.empty() == true)
+            {
+                Park(worker, left);
+                return;
+            }
+
+            // The batch policy takes several tasks in one critical section and runs them back to back
+            double       cursor = left;
+            const size_t count  = (Policy::Batch == config_.policy) ? config_.batch : 1;
+            for (size_t i = 0; i < count && (queues_[0].empty() == false || highQueue_.empty() == false); ++i)
+            {
+                std::deque<SimulatedTask>& source = (highQueue_.empty() == false) ? highQueue_ : queues_[0];
+                cursor                            = Execute(source.front(), cursor);
+                source.pop_front();
+            }
+            Schedule(cursor, WorkerFree, worker);
+            return;
+        }
+
+        // Own queue first, then victims in random order, each probe paid for
+        double cursor = Lock(worker, time);
+        if (queues_[worker].empty() == false)
+        {
+            Schedule(Execute(TakeFront(worker), cursor), WorkerFree, worker);
+            return;
+        }
+
+        const size_t first = std::uniform_int_distribution<size_t>(0, config_.workers - 1)(random_);
+        for (size_t probe = 0; probe < config_.workers; ++probe)
+        {
+            const size_t victim = (first + probe) % config_.workers;
+            if (victim == worker)
+            {
+                continue;
+            }
+
+            cursor += config_.stealCost;
+            overhead_ += config_.stealCost;
+            if (queues_[victim].empty() == false)
+            {
+                cursor = Lock(victim, cursor);
+                Schedule(Execute(TakeFront(victim), cursor), WorkerFree, worker);
+                return;
+            }
+        }
+        Park(worker, cursor);
+    }
+
+    SimulatedTask TakeFront(const size_t queue)
+    {
+        const SimulatedTask task = queues_[queue].front();
+        queues_[queue].pop_front();
+        return task;
+    }
+
+    ///
+    /// \brief Runs a task from the given time, returning its completion time
+    ///
+    double Execute(const SimulatedTask& task, const double start)
+    {
+        const double done = start + task.duration;
+        busy_ += task.duration;
+        latencies_.push_back(done - task.arrival);
+        if (true == task.high)
+        {
+            highLatencies_.push_back(done - task.arrival);
+        }
+        end_ = std::max(end_, done);
+        return done;
+    }
+
+    void Park(const size_t worker, const double time)
+    {
+        idle_[worker]      = true;
+        idleSince_[worker] = time;
+        idleWorkers_.push_back(worker);
+    }
+
+    void Wake(const size_t worker, const double time)
+    {
+        idle_[worker] = false;
+        idleWorkers_.erase(std::find(idleWorkers_.begin(), idleWorkers_.end(), worker));
+
+        // A spinning worker burned CPU while it waited; a parked one pays the wake-up
+        const double start = std::max(time, idleSince_[worker]);
+        if (true == config_.spinning)
+        {
+            spin_ += start - idleSince_[worker];
+        }
+        Schedule(start + ((true == config_.spinning) ? config_.spinCost : config_.wakeCost), WorkerFree, worker);
+    }
+
+    static double Percentile(std::vector<double> values, const double percentile)
+    {
+        if (values.empty() == true)
+        {
+            return 0.0;
+        }
+        const size_t rank = std::min(values.size() - 1, static_cast<size_t>(percentile / 100.0 * static_cast<double>(values.size())));
+        std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(rank), values.end());
+        return values[rank] / 1e3;
+    }
+};
+
+std::vector<std::string> Split(const std::string& text)
+{
+    std::vector<std::string> values;
+    size_t                   begin = 0;
+    for (size_t comma = text.find(','); std::string::npos != comma; comma = text.find(',', begin))
+    {
+        values.push_back(text.substr(begin, comma - begin));
+        begin = comma + 1;
+    }
+    values.push_back(text.substr(begin));
+    return values;
+}
+
+const char* PolicyName(const Policy policy)
+{
+    switch (policy)
+    {
+    case Policy::Global:
+        return "global";
+    case Policy::Stealing:
+        return "stealing";
+    case Policy::Priority:
+        return "priority";
+    case Policy::Batch:
+        return "batch";
+    }
+    return "?";
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::map<std::string, std::vector<std::string>> settings = {{"workers", {"4"}}, {"policy", {"global", "stealing"}}, {"idle", {"blocking"}},
+        {"load", {"0.5", "0.8", "0.9", "0.95"}}, {"arrivals", {"poisson"}}, {"dist", {"exp"}}, {"mean", {"50"}}, {"lock", {"0.1"}}, {"wake", {"5"}},
+        {"spin", {"0.2"}}, {"steal", {"0.3"}}, {"batch", {"8"}}, {"high", {"0.1"}}, {"tasks", {"200000"}}, {"seed", {"1"}}};
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const size_t      equals   = argument.find('=');
+        if (std::string::npos == equals || settings.end() == settings.find(argument.substr(0, equals)))
+        {
+            std::fprintf(stderr, "%s: unknown argument %s (see the file header for the keys)\n", argv[0], argv[i]);
+            return EXIT_FAILURE;
+        }
+        settings[argument.substr(0, equals)] = Split(argument.substr(equals + 1));
+    }
+
+    const std::map<std::string, Policy> policies = {
+        {"global", Policy::Global}, {"stealing", Policy::Stealing}, {"priority", Policy::Priority}, {"batch", Policy::Batch}};
+    const std::map<std::string, Distribution> distributions = {
+        {"fixed", Distribution::Fixed}, {"exp", Distribution::Exponential}, {"lognormal", Distribution::Lognormal}, {"bimodal", Distribution::Bimodal}};
+
+    // Names are checked up front, so that a typo does not silently run another model
+    const auto invalid = [&](const std::string& key, const std::function<bool(const std::string&)>& valid) {
+        for (const std::string& value : settings[key])
+        {
+            if (false == valid(value))
+            {
+                std::fprintf(stderr, "%s: invalid %s %s\n", argv[0], key.c_str(), value.c_str());
+                return true;
+            }
+        }
+        return false;
+    };
+    if (true == invalid("policy", [&](const std::string& value) { return 0 != policies.count(value); }) ||
+        true == invalid("dist", [&](const std::string& value) { return 0 != distributions.count(value); }) ||
+        true == invalid("idle", [](const std::string& value) { return "blocking" == value || "spinning" == value; }) ||
+        true == invalid("arrivals", [](const std::string& value) { return "poisson" == value || "fixed" == value; }))
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Every setting but the sweeps below takes the first value of its list
+    Config base {};
+    base.poisson      = ("poisson" == settings["arrivals"].front());
+    base.distribution = distributions.at(settings["dist"].front());
+    base.mean         = std::strtod(settings["mean"].front().c_str(), nullptr);
+    base.lockCost     = std::strtod(settings["lock"].front().c_str(), nullptr);
+    base.wakeCost     = std::strtod(settings["wake"].front().c_str(), nullptr);
+    base.spinCost     = std::strtod(settings["spin"].front().c_str(), nullptr);
+    base.stealCost    = std::strtod(settings["steal"].front().c_str(), nullptr);
+    base.high         = std::strtod(settings["high"].front().c_str(), nullptr);
+    base.tasks        = std::strtoull(settings["tasks"].front().c_str(), nullptr, 10);
+    base.seed         = std::strtoull(settings["seed"].front().c_str(), nullptr, 10);
+
+    std::printf("%7s %8s %8s %6s %5s %11s %11s %9s %9s %9s %9s %9s %6s\n", "workers", "policy", "idle", "batch", "load", "offered/s", "achieved/s", "p50 ms",
+        "p99 ms", "p99.9 ms", "hi p99", "cpu ms", "useful");
+    for (const std::string& workers : settings["workers"])
+    {
+        for (const std::string& policy : settings["policy"])
+        {
+            for (const std::string& idle : settings["idle"])
+            {
+                for (const std::string& batch : settings["batch"])
+                {
+                    for (const std::string& load : settings["load"])
+                    {
+                        Config config   = base;
+                        config.workers  = std::max<size_t>(1, std::strtoull(workers.c_str(), nullptr, 10));
+                        config.policy   = policies.at(policy);
+                        config.spinning = ("spinning" == idle);
+                        config.batch    = std::max<size_t>(1, std::strtoull(batch.c_str(), nullptr, 10));
+                        config.load     = std::strtod(load.c_str(), nullptr);
+                        if (Policy::Priority != config.policy)
+                        {
+                            config.high = 0.0;
+                        }
+
+                        const Result result  = Simulator(config).Run();
+                        const double offered = config.load * static_cast<double>(config.workers) / config.mean * 1e6;
+                        std::printf("%7zu %8s %8s %6zu %5.2f %11.0f %11.0f %9.3f %9.3f %9.3f %9.3f %9.1f %5.1f%%\n", config.workers, PolicyName(config.policy),
+                            (true == config.spinning) ? "spinning" : "blocking", config.batch, config.load, offered, result.throughput, result.p50, result.p99,
+                            result.p999, result.highP99, result.cpu, 100.0 * result.useful);
+                    }
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
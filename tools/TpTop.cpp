@@ -0,0 +1,222 @@
+///
+/// \file TpTop.cpp
+/// \brief Live top-like view of a pool that publishes its statistics into shared memory
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// Usage: tp-top [segment] [interval ms] [iterations]
+///
+/// The pool publishes through ThreadPool::EnableSharedStats. Without a segment
+/// name the tool attaches to the first segment found in /dev/shm. Every
+/// interval it shows the throughput, queue state and sojourn time percentiles
+/// of the pool and, per worker, the share of the interval spent running tasks,
+/// parked and on the CPU, together with its queue depth. Rates and
+/// percentiles cover the last interval only. With iterations zero (the
+/// default) it runs until interrupted.
+///
+
+#include "ThreadPoolSharedStats.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+int64_t MonotonicNanoseconds()
+{
+    timespec time {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return static_cast<int64_t>(time.tv_sec) * 1'000'000'000 + time.tv_nsec;
+}
+
+///
+/// \brief Formats a duration in nanoseconds with a unit that keeps it short
+///
+std::string FormatDuration(const double nanoseconds)
+{
+    char text[32];
+    if (nanoseconds < 1e3)
+    {
+        std::snprintf(text, sizeof(text), "%.0f ns", nanoseconds);
+    }
+    else if (nanoseconds < 1e6)
+    {
+        std::snprintf(text, sizeof(text), "%.1f us", nanoseconds / 1e3);
+    }
+    else if (nanoseconds < 1e9)
+    {
+        std::snprintf(text, sizeof(text), "%.1f ms", nanoseconds / 1e6);
+    }
+    else
+    {
+        std::snprintf(text, sizeof(text), "%.2f s", nanoseconds / 1e9);
+    }
+    return text;
+}
+
+///
+/// \brief Returns the upper bound of the histogram bucket holding the given percentile
+///
+/// Bucket b holds sojourn times below 2^b nanoseconds, so the result is at most
+/// twice the true percentile.
+///
+double Percentile(const uint64_t (&counts)[SharedStatsBuckets], const uint64_t total, const double percentile)
+{
+    const double rank = percentile / 100.0 * static_cast<double>(total);
+    uint64_t     seen = 0;
+    for (size_t bucket = 0; bucket < SharedStatsBuckets; ++bucket)
+    {
+        seen += counts[bucket];
+        if (0 != counts[bucket] && static_cast<double>(seen) >= rank)
+        {
+            return (0 == bucket) ? 0.0 : static_cast<double>(uint64_t(1) << bucket);
+        }
+    }
+    return static_cast<double>(uint64_t(1) << (SharedStatsBuckets - 1));
+}
+
+double Share(const int64_t part, const int64_t whole)
+{
+    return (whole > 0) ? 100.0 * static_cast<double>(part) / static_cast<double>(whole) : 0.0;
+}
+
+///
+/// \brief Prints the difference between two consecutive snapshots
+///
+void Print(const std::string& name, const SharedStatsSnapshot& previous, const SharedStatsSnapshot& current)
+{
+    const int64_t elapsed = current.timestamp - previous.timestamp;
+    const double  seconds = static_cast<double>(elapsed) / 1e9;
+    const auto    rate    = [seconds](const uint64_t now, const uint64_t before) {
+        return (seconds > 0.0) ? static_cast<double>(now - before) / seconds : 0.0;
+    };
+
+    uint64_t tasks         = 0;
+    uint64_t previousTasks = 0;
+    for (size_t i = 0; i < current.workers.size(); ++i)
+    {
+        tasks += current.workers[i].tasks;
+        previousTasks += previous.workers[i].tasks;
+    }
+
+    uint64_t sojourn[SharedStatsBuckets];
+    uint64_t dequeued = 0;
+    for (size_t bucket = 0; bucket < SharedStatsBuckets; ++bucket)
+    {
+        sojourn[bucket] = current.sojourn[bucket] - previous.sojourn[bucket];
+        dequeued += sojourn[bucket];
+    }
+
+    std::printf("pid %llu  %s  %zu workers  interval %s\n", static_cast<unsigned long long>(current.pid), name.c_str(), current.workers.size(),
+        FormatDuration(static_cast<double>(current.interval)).c_str());
+    std::printf("tasks/s %.0f  queued %llu  active %llu  parked %llu  stolen/s %.0f  rejected/s %.0f  overloaded %s  exceptions %llu  stuck %llu\n",
+        rate(tasks, previousTasks), static_cast<unsigned long long>(current.queuedTasks), static_cast<unsigned long long>(current.activeTasks),
+        static_cast<unsigned long long>(current.parkedWorkers), rate(current.stolenTasks, previous.stolenTasks),
+        rate(current.rejectedTasks, previous.rejectedTasks), (true == current.overloaded) ? "yes" : "no",
+        static_cast<unsigned long long>(current.unhandledExceptions), static_cast<unsigned long long>(current.stuckTasks));
+    if (0 != dequeued)
+    {
+        std::printf("sojourn  p50 < %s  p90 < %s  p99 < %s  p99.9 < %s  (%llu tasks)\n", FormatDuration(Percentile(sojourn, dequeued, 50.0)).c_str(),
+            FormatDuration(Percentile(sojourn, dequeued, 90.0)).c_str(), FormatDuration(Percentile(sojourn, dequeued, 99.0)).c_str(),
+            FormatDuration(Percentile(sojourn, dequeued, 99.9)).c_str(), static_cast<unsigned long long>(dequeued));
+    }
+    else
+    {
+        std::printf("sojourn  no tasks dequeued, last %s\n", FormatDuration(static_cast<double>(current.lastSojournTime)).c_str());
+    }
+
+    std::printf("\n%6s %10s %7s %7s %7s %7s\n", "WORKER", "TASKS/S", "%RUN", "%PARK", "%CPU", "QUEUE");
+    for (size_t i = 0; i < current.workers.size(); ++i)
+    {
+        const SharedStatsWorkerData& now    = current.workers[i];
+        const SharedStatsWorkerData& before = previous.workers[i];
+        std::printf("%6zu %10.0f %7.1f %7.1f %7.1f %7llu\n", i, rate(now.tasks, before.tasks), Share(now.runningTime - before.runningTime, elapsed),
+            Share(now.parkedTime - before.parkedTime, elapsed), Share(now.cpuTime - before.cpuTime, elapsed),
+            static_cast<unsigned long long>(now.queueDepth));
+    }
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string name = (argc > 1) ? argv[1] : std::string();
+    if (name.empty() == true)
+    {
+        const std::vector<std::string> names = SharedStatsSegment::List();
+        if (names.empty() == true)
+        {
+            std::fprintf(stderr, "%s: no pool publishes its statistics (see ThreadPool::EnableSharedStats)\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+        name = names.front();
+    }
+
+    SharedStatsSegment segment;
+    if (false == segment.Attach(name))
+    {
+        std::fprintf(stderr, "%s: cannot attach to %s (missing or incompatible layout)\n", argv[0], name.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // A new segment is filled by the pool's first publication right after it was created
+    SharedStatsSnapshot previous;
+    for (int attempt = 0; false == segment.Read(previous); ++attempt)
+    {
+        if (attempt >= 100)
+        {
+            std::fprintf(stderr, "%s: nothing was published to %s\n", argv[0], name.c_str());
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    const int64_t  interval   = (argc > 2) ? std::strtoll(argv[2], nullptr, 10) * 1'000'000 : previous.interval;
+    const uint64_t iterations = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 0;
+    const bool     terminal   = (1 == isatty(STDOUT_FILENO));
+
+    SharedStatsSnapshot current;
+    for (uint64_t iteration = 0; 0 == iterations || iteration < iterations; ++iteration)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(std::max<int64_t>(interval, 1'000'000)));
+        if (false == segment.Read(current))
+        {
+            continue;
+        }
+
+        // The mapping outlives the segment's removal, so a writer that exited or stopped publishing leaves its last update behind
+        if (current.sequence == previous.sequence)
+        {
+            if ((0 != kill(static_cast<pid_t>(current.pid), 0) && ESRCH == errno) ||
+                MonotonicNanoseconds() - current.timestamp > 3 * std::max<int64_t>(current.interval, interval))
+            {
+                std::fprintf(stderr, "%s: %s is not updated any more\n", argv[0], name.c_str());
+                return EXIT_FAILURE;
+            }
+            continue;
+        }
+
+        if (true == terminal)
+        {
+            std::printf("\x1b[H\x1b[2J");
+        }
+        else if (0 != iteration)
+        {
+            std::printf("\n");
+        }
+        Print(name, previous, current);
+        std::fflush(stdout);
+        std::swap(previous, current);
+    }
+    return EXIT_SUCCESS;
+}
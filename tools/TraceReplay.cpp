@@ -0,0 +1,263 @@
+///
+/// \file TraceReplay.cpp
+/// \brief Replays a recorded task trace against a configurable pool
+///
+/// \copyright Copyright (c) Heiko Panjas
+/// \license SPDX-License-Identifier: MIT
+///
+/// Usage: TraceReplay <trace file> [pool] [threads] [queue size]
+///
+/// pool is one of threadpool (default), fifo-blocking, fifo-spinning,
+/// ring-blocking or ring-spinning; the latter select the queue and idle
+/// policies of BasicThreadPool.
+///
+/// Recorded by ThreadPool::StartTraceRecording. Tasks submitted from outside
+/// the pool are resubmitted at their recorded arrival times; every task busy-
+/// waits for its recorded duration and submits its children at the same
+/// offsets into its run as in the recording. The tool prints the queueing
+/// delay (arrival to start) and the makespan of the recording next to those
+/// of the replay, overall and per tag.
+///
+
+#include "BasicThreadPool.h"
+#include "ThreadPool.h"
+#include "ThreadPoolTrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+///
+/// \brief Trace prepared for replay: children grouped under their parents
+///
+struct Schedule
+{
+    std::vector<TraceTaskRecord>     tasks;    ///< Records, sorted by arrival
+    std::vector<std::vector<size_t>> children; ///< Indices of the children of every task, by arrival
+    std::vector<size_t>              roots;    ///< Indices of the tasks submitted from outside the pool, by arrival
+};
+
+///
+/// \brief Start and end of every replayed task, relative to the replay start
+///
+struct Timing
+{
+    std::vector<int64_t> arrival; ///< Time the task was submitted
+    std::vector<int64_t> start;   ///< Time a worker started it
+    std::vector<int64_t> end;     ///< Time it finished
+};
+
+int64_t Now(const std::chrono::steady_clock::time_point origin)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+}
+
+void SpinUntil(const std::chrono::steady_clock::time_point origin, const int64_t deadline)
+{
+    while (Now(origin) < deadline)
+    {
+    }
+}
+
+Schedule BuildSchedule(const TraceFile& trace)
+{
+    Schedule schedule;
+    schedule.tasks = trace.tasks;
+    std::sort(schedule.tasks.begin(), schedule.tasks.end(), [](const TraceTaskRecord& a, const TraceTaskRecord& b) { return a.arrival < b.arrival; });
+
+    std::unordered_map<uint64_t, size_t> index;
+    for (size_t i = 0; i < schedule.tasks.size(); ++i)
+    {
+        index.emplace(schedule.tasks[i].id, i);
+    }
+
+    // Tasks whose parent was not recorded (it was submitted before the recording started) become roots
+    schedule.children.resize(schedule.tasks.size());
+    for (size_t i = 0; i < schedule.tasks.size(); ++i)
+    {
+        const auto parent = index.find(schedule.tasks[i].parent);
+        if (0 != schedule.tasks[i].parent && index.end() != parent)
+        {
+            schedule.children[parent->second].push_back(i);
+        }
+        else
+        {
+            schedule.roots.push_back(i);
+        }
+    }
+    return schedule;
+}
+
+///
+/// \brief Replays the schedule on one pool type
+///
+template<class Pool> Timing Replay(Pool& pool, const Schedule& schedule)
+{
+    Timing timing;
+    timing.arrival.assign(schedule.tasks.size(), 0);
+    timing.start.assign(schedule.tasks.size(), 0);
+    timing.end.assign(schedule.tasks.size(), 0);
+
+    const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    const int64_t                               offset = schedule.tasks.empty() ? 0 : schedule.tasks.front().arrival;
+
+    // Every task writes only its own timing slots, so the vectors need no lock
+    std::function<void(size_t)> run = [&](const size_t i) {
+        const TraceTaskRecord& task  = schedule.tasks[i];
+        const int64_t          start = Now(origin);
+        timing.start[i]              = start;
+        for (const size_t child : schedule.children[i])
+        {
+            SpinUntil(origin, start + std::clamp<int64_t>(schedule.tasks[child].arrival - task.start, 0, task.duration));
+            timing.arrival[child] = Now(origin);
+            pool.Enqueue(run, child);
+        }
+        SpinUntil(origin, start + task.duration);
+        timing.end[i] = Now(origin);
+    };
+
+    for (const size_t root : schedule.roots)
+    {
+        const int64_t intended = schedule.tasks[root].arrival - offset;
+        while (Now(origin) < intended)
+        {
+            if (intended - Now(origin) > 200'000)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(intended - Now(origin) - 100'000));
+            }
+        }
+
+        // Arrival is the intended time, so time the submitter spent blocked counts as queueing delay
+        timing.arrival[root] = intended;
+        pool.Enqueue(run, root);
+    }
+    pool.WaitForAllTasks();
+    return timing;
+}
+
+int64_t Percentile(std::vector<int64_t> values, const double percentile)
+{
+    if (values.empty() == true)
+    {
+        return 0;
+    }
+    const size_t rank = std::min(values.size() - 1, static_cast<size_t>(percentile / 100.0 * static_cast<double>(values.size())));
+    std::nth_element(values.begin(), values.begin() + static_cast<std::ptrdiff_t>(rank), values.end());
+    return values[rank];
+}
+
+void PrintDelays(const char* name, const std::vector<int64_t>& recorded, const std::vector<int64_t>& replayed)
+{
+    std::printf("%-24s %8zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, recorded.size(), Percentile(recorded, 50.0) / 1e3,
+        Percentile(replayed, 50.0) / 1e3, Percentile(recorded, 99.0) / 1e3, Percentile(replayed, 99.0) / 1e3, Percentile(recorded, 99.9) / 1e3,
+        Percentile(replayed, 99.9) / 1e3);
+}
+
+void Report(const TraceFile& trace, const Schedule& schedule, const Timing& timing)
+{
+    // Queueing delay per tag, recorded and replayed side by side
+    std::vector<std::vector<int64_t>> recorded(trace.tags.size());
+    std::vector<std::vector<int64_t>> replayed(trace.tags.size());
+    std::vector<int64_t>              allRecorded;
+    std::vector<int64_t>              allReplayed;
+    int64_t                           recordedEnd = 0;
+    int64_t                           replayedEnd = 0;
+    for (size_t i = 0; i < schedule.tasks.size(); ++i)
+    {
+        const TraceTaskRecord& task = schedule.tasks[i];
+        const size_t           tag  = (task.tag < trace.tags.size()) ? task.tag : 0;
+        recorded[tag].push_back(task.start - task.arrival);
+        replayed[tag].push_back(timing.start[i] - timing.arrival[i]);
+        allRecorded.push_back(task.start - task.arrival);
+        allReplayed.push_back(timing.start[i] - timing.arrival[i]);
+        recordedEnd = std::max(recordedEnd, task.start + task.duration - schedule.tasks.front().arrival);
+        replayedEnd = std::max(replayedEnd, timing.end[i]);
+    }
+
+    std::printf("makespan: recorded %.3f ms, replayed %.3f ms\n\n", recordedEnd / 1e6, replayedEnd / 1e6);
+    std::printf("%-24s %8s %10s %10s %10s %10s %10s %10s\n", "queueing delay in us", "tasks", "p50 rec", "p50 rep", "p99 rec", "p99 rep", "p99.9 rec",
+        "p99.9 rep");
+    PrintDelays("(all)", allRecorded, allReplayed);
+    for (size_t tag = 0; tag < trace.tags.size(); ++tag)
+    {
+        if (recorded[tag].empty() == false)
+        {
+            PrintDelays((0 == tag) ? "(untagged)" : trace.tags[tag].c_str(), recorded[tag], replayed[tag]);
+        }
+    }
+}
+
+template<class Pool> Timing ReplayOn(const Schedule& schedule, const size_t threadCount, const size_t queueSize)
+{
+    Pool pool(threadCount, queueSize);
+    return Replay(pool, schedule);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <trace file> [threadpool|fifo-blocking|fifo-spinning|ring-blocking|ring-spinning] [threads] [queue size]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const std::string pool        = (argc > 2) ? argv[2] : "threadpool";
+    const size_t      threadCount = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : std::thread::hardware_concurrency();
+    const size_t      queueSize   = (argc > 4) ? std::strtoull(argv[4], nullptr, 10) : 1'000'000;
+
+    TraceFile trace;
+    if (false == ReadTraceFile(argv[1], trace))
+    {
+        std::fprintf(stderr, "%s: cannot read trace file %s\n", argv[0], argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    const Schedule schedule = BuildSchedule(trace);
+    std::printf("%zu tasks (%zu submitted from outside), %zu tags; replaying on %s with %zu threads\n", schedule.tasks.size(), schedule.roots.size(),
+        trace.tags.size() - 1, pool.c_str(), threadCount);
+
+    // Ring queues have a fixed capacity; a producer inside a task blocks while it is full
+    using FifoBlocking = BasicThreadPool<FifoQueuePolicy, BlockingIdlePolicy, FunctionTaskPolicy, NoMetricsPolicy>;
+    using FifoSpinning = BasicThreadPool<FifoQueuePolicy, SpinningIdlePolicy<>, FunctionTaskPolicy, NoMetricsPolicy>;
+    using RingBlocking = BasicThreadPool<RingQueuePolicy<65'536>, BlockingIdlePolicy, FunctionTaskPolicy, NoMetricsPolicy>;
+    using RingSpinning = BasicThreadPool<RingQueuePolicy<65'536>, SpinningIdlePolicy<>, FunctionTaskPolicy, NoMetricsPolicy>;
+
+    Timing timing;
+    if ("threadpool" == pool)
+    {
+        timing = ReplayOn<ThreadPool>(schedule, threadCount, queueSize);
+    }
+    else if ("fifo-blocking" == pool)
+    {
+        timing = ReplayOn<FifoBlocking>(schedule, threadCount, queueSize);
+    }
+    else if ("fifo-spinning" == pool)
+    {
+        timing = ReplayOn<FifoSpinning>(schedule, threadCount, queueSize);
+    }
+    else if ("ring-blocking" == pool)
+    {
+        timing = ReplayOn<RingBlocking>(schedule, threadCount, queueSize);
+    }
+    else if ("ring-spinning" == pool)
+    {
+        timing = ReplayOn<RingSpinning>(schedule, threadCount, queueSize);
+    }
+    else
+    {
+        std::fprintf(stderr, "%s: unknown pool %s\n", argv[0], pool.c_str());
+        return EXIT_FAILURE;
+    }
+
+    Report(trace, schedule, timing);
+    return EXIT_SUCCESS;
+}